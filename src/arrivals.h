@@ -0,0 +1,143 @@
+#ifndef _ARRIVALS_H
+#define _ARRIVALS_H
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "const.h"
+#include "objects.h"
+#include "tools.h"
+#include "trace.h"
+
+/* =========================================================================
+ * Arrival process
+ * With an ARRIVAL_RATE or ARRIVAL_PROFILE the client processes still live for
+ * the whole simulation, but each day their groups wait at the door
+ * (group_arrival_wait) until the coordinator admits them. Every minute it
+ * draws how many users arrive from a Poisson distribution with the profile
+ * rate at that minute and admits whole groups, in index order, until they
+ * cover that many users; a group bigger than the draw leaves a debt for the
+ * next minutes, so the mean rate is kept. Groups not admitted by the end of
+ * the day just do not come.
+ * ========================================================================= */
+
+/* Largest mean drawn in one go, exp(-mean) must stay far from underflow */
+#define POISSON_CHUNK 30.0
+
+static struct {
+    size_t next;      // prossimo gruppo da far entrare
+    long   owed;      // utenti estratti e non ancora entrati (< 0 = debito)
+    bool   exhausted; // tutti i gruppi entrati, gia' segnalato nel log
+} g_arrivals;
+
+/**
+ * @brief Tells whether the groups arrive over the day or all at once.
+ */
+static inline bool
+arrivals_open_loop(const conf_t *conf) {
+    return conf->arrival_points > 0;
+}
+
+/**
+ * @brief Arrival rate of the profile at a minute of the day.
+ * * Linear between two points, constant before the first and after the last.
+ * @return Users per minute.
+ */
+static inline double
+arrival_rate(const conf_t *conf, const double min) {
+    const int     n   = conf->arrival_points;
+    const double(*pt)[2] = conf->arrival_profile;
+
+    if (n == 0)
+        return 0;
+    if (min <= pt[0][0])
+        return pt[0][1];
+
+    it(i, 1, n) {
+        if (min <= pt[i][0]) {
+            const double f = (min - pt[i - 1][0]) / (pt[i][0] - pt[i - 1][0]);
+            return pt[i - 1][1] + f * (pt[i][1] - pt[i - 1][1]);
+        }
+    }
+    return pt[n - 1][1];
+}
+
+/**
+ * @brief Draws from a Poisson distribution (Knuth's product of uniforms).
+ * * Big means are split in chunks, the sum of Poisson variables is Poisson.
+ */
+static inline long
+poisson_draw(double mean) {
+    long k = 0;
+
+    while (mean > 0) {
+        const double chunk = mean < POISSON_CHUNK ? mean : POISSON_CHUNK;
+        const double limit = exp(-chunk);
+        double       p     = 1.0;
+
+        while ((p *= (rand() + 1.0) / (RAND_MAX + 2.0)) > limit)
+            k++;
+        mean -= chunk;
+    }
+    return k;
+}
+
+/**
+ * @brief Sets every group for a new day, before the day is opened.
+ * * Without a profile all of them are admitted already.
+ * @return Users admitted at the opening.
+ */
+static inline uint32_t
+arrivals_reset(simctx_t *ctx) {
+    const bool open_loop = arrivals_open_loop(&ctx->config);
+
+    g_arrivals.next      = 0;
+    g_arrivals.owed      = 0;
+    g_arrivals.exhausted = false;
+
+    it(i, 0, ctx->config.nof_users) {
+        ctx->groups[i].arrival = open_loop ? ARRIVAL_WAIT : ARRIVAL_IN;
+    }
+    return open_loop ? 0 : (uint32_t)ctx->config.nof_users;
+}
+
+/**
+ * @brief Admits the users arriving during one minute of the day.
+ * @param ctx Global context.
+ * @param min Minute of the day.
+ * @return Users admitted.
+ */
+static inline size_t
+arrivals_tick(simctx_t *ctx, const size_t min) {
+    const size_t groups = (size_t)ctx->config.nof_users;
+    size_t       in     = 0;
+
+    if (!arrivals_open_loop(&ctx->config) || g_arrivals.exhausted)
+        return 0;
+
+    g_arrivals.owed += trace_arrivals(
+        ctx, min, poisson_draw(arrival_rate(&ctx->config, (double)min))
+    );
+
+    while (g_arrivals.owed > 0 && g_arrivals.next < groups) {
+        struct groups_t *group = &ctx->groups[g_arrivals.next++];
+
+        /* Unused slot, or a group that add-users let in already */
+        if (group->total_members == 0 || group->arrival != ARRIVAL_WAIT)
+            continue;
+
+        group_admit(ctx, group);
+        g_arrivals.owed -= (long)group->total_members;
+        in += group->total_members;
+    }
+
+    if (g_arrivals.next == groups && !g_arrivals.exhausted) {
+        g_arrivals.exhausted = true;
+        zprintf(
+            ctx->sem[out], "MAIN: Every group arrived by minute %zu\n", min
+        );
+    }
+    return in;
+}
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "const.h"
+#include "objects.h"
+#include "tools.h"
+
+/* =========================================================================
+ * Checkpoint
+ * At the end of every completed day the coordinator saves to
+ * <run dir>/checkpoint.bin what the next day starts from: the config as it
+ * is now (set-param and add-users included), global and per station totals,
+ * the food left, a running disorder, and the population (group of every
+ * client, ticket flags and group sizes). --resume rebuilds the IPC objects,
+ * respawns the same population and goes on with the following day.
+ *
+ * The file is a raw dump of the structures, valid only for the build that
+ * wrote it: the header carries their sizes and a mismatch is refused.
+ *   "OGCK", u32 version, u32 sizeof(conf_t), u32 sizeof(stats), u32 days,
+ *   conf_t, stats global, stats total[NOF_STATIONS], i32 users_left,
+ *   u32 disorder_left, u64 nof_slots, u64 quantity[nof_slots],
+ *   u32 users, u32 group[users], u8 ticket[users], u32 group_size[users],
+ *   i64 csv_bytes
+ * ========================================================================= */
+
+#define CKPT_FILE "checkpoint.bin"
+#define CKPT_MAGIC "OGCK"
+#define CKPT_VERSION 1
+
+/* Content of a checkpoint, filled by ckpt_load */
+static struct {
+    uint32_t days;          // giorni completati
+    conf_t   config;
+    stats    global_stats;
+    stats    total_stats[NOF_STATIONS];
+    int32_t  users_left;
+    uint32_t disorder_left; // minuti del disorder in corso, 0 = nessuno
+    uint64_t nof_slots;
+    uint64_t *quantity;
+    uint32_t users;
+    uint32_t group[MAX_TOTAL_USERS];
+    uint8_t  ticket[MAX_TOTAL_USERS];
+    uint32_t group_size[MAX_TOTAL_USERS];
+    int64_t  csv_bytes; // stats.csv fino a quel giorno compreso
+} g_ckpt;
+
+/**
+ * @brief Reads exactly n bytes of the checkpoint.
+ */
+static inline void
+ckpt_read(FILE *file, void *buf, const size_t n) {
+    if (fread(buf, 1, n, file) != n)
+        panic("ERROR: Checkpoint truncated or corrupted\n");
+}
+
+/**
+ * @brief Saves the state left by a completed day.
+ * * Written to a temporary file and renamed, so an interruption while saving
+ * keeps the previous checkpoint.
+ * @param days Days completed so far.
+ * @param disorder_left Minutes left of a running disorder, 0 if none.
+ * @param group Group of every client, by spawn index.
+ * @param ticket Ticket flag of every client, by spawn index.
+ */
+static void
+ckpt_save(
+    const simctx_t *ctx,
+    const station  *st,
+    menu_t         *menu,
+    const size_t    days,
+    const int       users_left,
+    const size_t    disorder_left,
+    const size_t   *group,
+    const bool     *ticket
+) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", run_path(CKPT_FILE));
+
+    FILE *file = fopen(tmp, "wb");
+    if (file == NULL) {
+        zprintf(ctx->sem[out], "MAIN: Unable to write %s\n", tmp);
+        return;
+    }
+
+    const uint32_t head[4] = {
+        CKPT_VERSION, sizeof(conf_t), sizeof(stats), (uint32_t)days
+    };
+    fwrite(CKPT_MAGIC, 1, 4, file);
+    fwrite(head, sizeof(head), 1, file);
+    fwrite(&ctx->config, sizeof(conf_t), 1, file);
+    fwrite(&ctx->global_stats, sizeof(stats), 1, file);
+    it(i, 0, NOF_STATIONS) fwrite(&st[i].total_stats, sizeof(stats), 1, file);
+
+    const int32_t  left     = users_left;
+    const uint32_t disorder = (uint32_t)disorder_left;
+    fwrite(&left, sizeof(left), 1, file);
+    fwrite(&disorder, sizeof(disorder), 1, file);
+
+    const uint64_t nof_slots = menu->nof_slots;
+    fwrite(&nof_slots, sizeof(nof_slots), 1, file);
+    it(i, 0, nof_slots) {
+        const uint64_t qty = menu->slots[i].quantity;
+        fwrite(&qty, sizeof(qty), 1, file);
+    }
+
+    const uint32_t users = (uint32_t)ctx->config.nof_users;
+    fwrite(&users, sizeof(users), 1, file);
+    it(i, 0, users) {
+        const uint32_t g = (uint32_t)group[i];
+        fwrite(&g, sizeof(g), 1, file);
+    }
+    it(i, 0, users) {
+        const uint8_t t = ticket[i];
+        fwrite(&t, sizeof(t), 1, file);
+    }
+    it(i, 0, users) {
+        const uint32_t size = (uint32_t)ctx->groups[i].total_members;
+        fwrite(&size, sizeof(size), 1, file);
+    }
+
+    struct stat csv;
+    const int64_t csv_bytes =
+        stat(run_path("stats.csv"), &csv) == 0 ? (int64_t)csv.st_size : 0;
+    fwrite(&csv_bytes, sizeof(csv_bytes), 1, file);
+
+    if (fclose(file) != 0 || rename(tmp, run_path(CKPT_FILE)) == -1)
+        zprintf(ctx->sem[out], "MAIN: Unable to write %s\n", tmp);
+}
+
+/**
+ * @brief Loads a checkpoint into g_ckpt, before any IPC resource exists.
+ */
+static void
+ckpt_load(const char *path) {
+    FILE    *file = zfopen(path, "rb");
+    char     magic[4];
+    uint32_t head[4];
+
+    ckpt_read(file, magic, sizeof(magic));
+    ckpt_read(file, head, sizeof(head));
+    if (memcmp(magic, CKPT_MAGIC, sizeof(magic)) != 0 ||
+        head[0] != CKPT_VERSION || head[1] != sizeof(conf_t) ||
+        head[2] != sizeof(stats))
+        panic("ERROR: %s is not a checkpoint of this build\n", path);
+    g_ckpt.days = head[3];
+
+    ckpt_read(file, &g_ckpt.config, sizeof(conf_t));
+    ckpt_read(file, &g_ckpt.global_stats, sizeof(stats));
+    ckpt_read(file, g_ckpt.total_stats, sizeof(g_ckpt.total_stats));
+    ckpt_read(file, &g_ckpt.users_left, sizeof(g_ckpt.users_left));
+    ckpt_read(file, &g_ckpt.disorder_left, sizeof(g_ckpt.disorder_left));
+
+    ckpt_read(file, &g_ckpt.nof_slots, sizeof(g_ckpt.nof_slots));
+    if (g_ckpt.nof_slots > MAX_DISH_ID + 1)
+        panic("ERROR: Checkpoint corrupted\n");
+    g_ckpt.quantity = zcalloc(g_ckpt.nof_slots + 1, sizeof(uint64_t));
+    ckpt_read(file, g_ckpt.quantity, g_ckpt.nof_slots * sizeof(uint64_t));
+
+    ckpt_read(file, &g_ckpt.users, sizeof(g_ckpt.users));
+    if (g_ckpt.users == 0 || g_ckpt.users > MAX_TOTAL_USERS)
+        panic("ERROR: Checkpoint corrupted\n");
+    ckpt_read(file, g_ckpt.group, g_ckpt.users * sizeof(uint32_t));
+    ckpt_read(file, g_ckpt.ticket, g_ckpt.users);
+    ckpt_read(file, g_ckpt.group_size, g_ckpt.users * sizeof(uint32_t));
+    ckpt_read(file, &g_ckpt.csv_bytes, sizeof(g_ckpt.csv_bytes));
+    fclose(file);
+
+    it(i, 0, g_ckpt.users) {
+        if (g_ckpt.group[i] >= g_ckpt.users)
+            panic("ERROR: Checkpoint corrupted\n");
+    }
+}
+
+/**
+ * @brief Puts the totals and the food of the checkpoint back in place.
+ * * The menu must be the one the checkpoint was taken with.
+ */
+static void
+ckpt_restore(simctx_t *ctx, station *st, menu_t *menu) {
+    if (g_ckpt.nof_slots != menu->nof_slots)
+        panic("ERROR: The checkpoint was taken with another menu\n");
+
+    ctx->global_stats = g_ckpt.global_stats;
+    it(i, 0, NOF_STATIONS) st[i].total_stats = g_ckpt.total_stats[i];
+    it(i, 0, menu->nof_slots) menu->slots[i].quantity = g_ckpt.quantity[i];
+    free(g_ckpt.quantity);
+    g_ckpt.quantity = NULL;
+}
+
+/**
+ * @brief Tells whether a checkpoint is the one of the current run directory,
+ * i.e. the run goes on where it stopped instead of forking a new one.
+ */
+static bool
+ckpt_in_run_dir(const char *path) {
+    struct stat a, b;
+    return stat(path, &a) == 0 && stat(run_path(CKPT_FILE), &b) == 0 &&
+           a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+}
+
+#endif
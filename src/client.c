@@ -10,17 +10,25 @@
 #include "msg.h"
 #include "objects.h"
 #include "tools.h"
+#include "trace.h"
 #include <signal.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+/* =============================================================================
+ * Global State
+ * ========================================================================== */
+
+/** Dish catalog, attached once at startup and shared by every day. */
+static menu_t *g_menu = NULL;
+
 /* =============================================================================
  * Prototypes
  * ========================================================================== */
 
-void pick_dishes(ssize_t *menu, const simctx_t *ctx);
+void pick_dishes(ssize_t *menu, menu_t *catalog);
 void send_request(
     const simctx_t  *ctx,
     client_t        *self,
@@ -30,6 +38,14 @@ void send_request(
 );
 static bool
 ask_dish(const simctx_t *ctx, client_t *self, msg_t *msg, msg_t *response);
+static bool pay_for_group(
+    const simctx_t  *ctx,
+    const client_t  *self,
+    msg_t           *msg,
+    msg_t           *response,
+    const size_t     collected,
+    struct groups_t *group
+);
 
 /* =============================================================================
  * Main logic
@@ -41,7 +57,7 @@ ask_dish(const simctx_t *ctx, client_t *self, msg_t *msg, msg_t *response);
  * simulation loop where the client picks dishes and attempts to be served.
  *
  * @param argc Argument count.
- * @param argv Expected: {exec, ticket_bool, shmid, group_id}.
+ * @param argv Expected: {exec, ticket_bool, shmid, group_id, client_idx}.
  * @return int Exit status.
  */
 int
@@ -49,13 +65,14 @@ main(const int argc, char **argv) {
     /* Ignore CTRL+C as the client lifecycle is managed by the coordinator. */
     signal(SIGINT, SIG_IGN);
 
-    if (argc != 4)
+    if (argc != 5)
         panic("ERROR: Invalid client arguments for pid: %d", getpid());
 
     /* Parse simulation parameters from arguments. */
     const bool   ticket = atob(argv[1]);
     const size_t shmid  = atos(argv[2]);
     const size_t grp_id = atos(argv[3]);
+    const size_t idx    = atos(argv[4]);
 
     /* Set up SIGUSR1 handler for simulation interrupts. */
     struct sigaction sa;
@@ -64,19 +81,36 @@ main(const int argc, char **argv) {
     sa.sa_flags = 0;
     sigaction(SIGUSR1, &sa, NULL);
 
+    const simctx_t *boot = get_ctx(shmid);
+    g_menu               = get_menu(boot->menu_shm);
+    srand(stream_seed(boot->seed, SEED_CLIENT | (uint32_t)idx));
+    if (trace_register(boot, getpid(), idx) < 0)
+        zprintf(
+            boot->sem[out],
+            "CLIENT %d: Trace table full, service times drawn live\n",
+            getpid()
+        );
+
+    uint32_t day = 0;
     while (true) {
-        const simctx_t  *ctx   = get_ctx(shmid);
-        struct groups_t *group = (struct groups_t *)&ctx->groups[grp_id];
+        simctx_t        *ctx   = get_ctx(shmid);
+        struct groups_t *group = &ctx->groups[grp_id];
 
         zprintf(ctx->sem[out], "CLIENT: Waiting new day\n");
 
         /* Wait for the start-of-day barrier. */
-        sem_wait(ctx->sem[wall]);
+        day = day_wait(ctx, day);
 
         /* Check if simulation was shut down while waiting. */
         if (!ctx->is_sim_running)
             break;
 
+        /* With an arrival profile the group may come later, or not today. */
+        if (!group_arrival_wait(group)) {
+            day_leave(ctx, false);
+            continue;
+        }
+
         /* Initialize client state for the current day. */
         client_t self = {
             .pid       = getpid(),
@@ -89,7 +123,8 @@ main(const int argc, char **argv) {
         };
 
         /* Decide what to eat today. */
-        pick_dishes(self.dishes, ctx);
+        pick_dishes(self.dishes, g_menu);
+        trace_dishes(ctx, idx, self.dishes);
 
         msg_t response;
         int   price = 0;
@@ -97,8 +132,8 @@ main(const int argc, char **argv) {
         /* Execute the request lifecycle. */
         send_request(ctx, &self, &response, &price, group);
 
-        /* Wait for end-of-day synchronization. */
-        sem_wait(ctx->sem[cl_end]);
+        /* Leave the day, the last one out wakes the coordinator. */
+        day_leave(ctx, true);
         if (!ctx->is_sim_running) {
             zprintf(
                 ctx->sem[out], "CLIENT %d: Day finished, exiting.\n", getpid()
@@ -115,11 +150,11 @@ main(const int argc, char **argv) {
  * * The client picks up to one dish for First Course, Main Course, and Coffee.
  * The loop ensures that the client picks at least one substantial course.
  *
- * @param menu Array to store selected dish IDs.
- * @param ctx  Simulation context for menu data.
+ * @param menu    Array to store selected dish IDs.
+ * @param catalog Shared dish catalog.
  */
 void
-pick_dishes(ssize_t *menu, const simctx_t *ctx) {
+pick_dishes(ssize_t *menu, menu_t *catalog) {
     ssize_t rnd;
     ssize_t cur_loc;
     size_t  cnt_nf;
@@ -129,30 +164,30 @@ pick_dishes(ssize_t *menu, const simctx_t *ctx) {
         cnt_nf  = 0;
 
         /* Pick First Course (-1 represents skipping/not available). */
-        rnd = (ssize_t)(rand() % (ctx->menu[FIRST].size + 1) - 1);
+        rnd = (ssize_t)(rand() % (catalog->cat[FIRST].size + 1) - 1);
         if (rnd != -1) {
             cur_loc     = FIRST_COURSE;
-            menu[FIRST] = (ssize_t)ctx->menu[FIRST].data[rnd].id;
+            menu[FIRST] = (ssize_t)menu_slot(catalog, FIRST, rnd)->info.id;
         } else {
             cnt_nf++;
             menu[FIRST] = -1;
         }
 
         /* Pick Main Course. */
-        rnd = (ssize_t)(rand() % (ctx->menu[MAIN].size + 1) - 1);
+        rnd = (ssize_t)(rand() % (catalog->cat[MAIN].size + 1) - 1);
         if (rnd != -1) {
             if (cur_loc == -1)
                 cur_loc = MAIN;
-            menu[MAIN] = (ssize_t)ctx->menu[MAIN].data[rnd].id;
+            menu[MAIN] = (ssize_t)menu_slot(catalog, MAIN, rnd)->info.id;
         } else {
             cnt_nf++;
             menu[MAIN] = -1;
         }
 
         /* Pick Coffee. */
-        rnd = (ssize_t)(rand() % (ctx->menu[COFFEE].size + 1) - 1);
+        rnd = (ssize_t)(rand() % (catalog->cat[COFFEE].size + 1) - 1);
         if (rnd != -1) {
-            menu[COFFEE] = (ssize_t)ctx->menu[COFFEE].data[rnd].id;
+            menu[COFFEE] = (ssize_t)menu_slot(catalog, COFFEE, rnd)->info.id;
         } else {
             menu[COFFEE] = -1;
         }
@@ -188,18 +223,28 @@ send_request(
         if (self->loc < NOF_STATIONS)
             self->msgq = ctx->id_msg_q[self->loc];
 
+        /* Dishes on the tray, what the checkout takes longer with */
+        const size_t items = self->loc == CHECKOUT ? collected : 1;
+
         /* Prepare the standard request message. */
         msg_t msg = {
             /* mtype contains:
-             * - Priority if sent by client.
+             * - The station's queue discipline order if sent by client.
              * - Client PID if it's a worker response. */
-            .mtype = (self->loc == CHECKOUT && self->ticket) ? TICKET : DEFAULT,
+            .mtype = self->loc < NOF_STATIONS
+                         ? request_mtype(
+                               ctx->config.queue_discipline[self->loc],
+                               self->ticket, items
+                           )
+                         : DEFAULT,
             .client = self->pid,
             .dish =
                 {self->loc < 3 ? (size_t)self->dishes[self->loc] : 0, "", 0, 0},
             .status = REQUEST_OK,
             .price  = self->loc == CHECKOUT ? (size_t)*price : 0,
             .ticket = self->ticket,
+            .items  = (uint8_t)items,
+            .body   = BODY_DISH,
         };
 
         if (self->loc < 3 && self->dishes[self->loc] != -1) {
@@ -231,19 +276,25 @@ send_request(
              * Clients must wait for all members of their group before paying.
              * ==================================================================
              */
-            sem_wait(ctx->sem[shm]);
-            group->members_ready++;
+            if (ctx->config.group_checkout) {
+                if (!pay_for_group(ctx, self, &msg, response, collected, group))
+                    return;
+                break;
+            }
 
-            if (group->members_ready == group->total_members) {
-                /* Last member arrived: wake up everyone else. */
-                it(i, 0, group->total_members - 1) { sem_signal(group->sem); }
-                group->members_ready = 0;
-                sem_signal(ctx->sem[shm]);
+            bool           last;
+            const uint32_t gen = group_arrive(group, &last);
 
+            if (last) {
+                /* Last member arrived: wake up everyone else. */
+                group_release(group);
             } else {
-                /* Wait for the rest of the group. */
-                sem_signal(ctx->sem[shm]);
-                sem_wait(group->sem);
+                /* Wait for the rest of the group, a signal is no reason to
+                 * stop while the day goes on */
+                while (group_wait(ctx, group, gen) == -1 && errno == EINTR &&
+                       __atomic_load_n(&group->generation, __ATOMIC_ACQUIRE) ==
+                           gen)
+                    ;
             }
 
             /* If no food was collected (all stations empty), exit early. */
@@ -276,7 +327,7 @@ send_request(
             );
 
             /* Simulate eating time accumulated from dishes. */
-            znsleep(self->wait_time);
+            day_sleep(ctx, self->wait_time);
 
             zprintf(ctx->sem[out], "CLIENT %d: Leaving table\n", self->pid);
 
@@ -308,12 +359,17 @@ send_request(
  */
 static bool
 ask_dish(const simctx_t *ctx, client_t *self, msg_t *msg, msg_t *response) {
-    bool tried[MAX_ELEMENTS];
-    memset(tried, 0, sizeof(tried));
+    const dish_type type      = (dish_type)self->loc;
+    const size_t    menu_size = g_menu->cat[type].size;
+
+    /* One flag per catalog slot of this category, indexed by slot offset. */
+    bool *tried = zcalloc(menu_size ? menu_size : 1, sizeof(bool));
+    bool  got   = false;
 
     /* Mark the initial preferred dish as tried. */
-    if (msg->dish.id < MAX_ELEMENTS)
-        tried[msg->dish.id] = true;
+    const dish_slot_t *pref = menu_find(g_menu, type, msg->dish.id);
+    if (pref)
+        tried[pref - menu_slot(g_menu, type, 0)] = true;
 
     while (ctx->is_sim_running) {
         send_msg(self->msgq, *msg, sizeof(msg_t) - sizeof(long));
@@ -324,7 +380,7 @@ ask_dish(const simctx_t *ctx, client_t *self, msg_t *msg, msg_t *response) {
 
         int res = recive_msg(self->msgq, self->pid, response);
         if (res == -1) {
-            return false;
+            break;
         }
 
         /* Success: dish obtained. */
@@ -333,7 +389,8 @@ ask_dish(const simctx_t *ctx, client_t *self, msg_t *msg, msg_t *response) {
                 ctx->sem[out], "CLIENT %d: Obtained dish %zu\n", self->pid,
                 response->dish.id
             );
-            return true;
+            got = true;
+            break;
         }
 
         /* Case 1: The entire station category (e.g., all First Courses) is out
@@ -344,7 +401,7 @@ ask_dish(const simctx_t *ctx, client_t *self, msg_t *msg, msg_t *response) {
                 "CLIENT %d: Station %d empty, skipping course.\n", self->pid,
                 self->loc
             );
-            return false;
+            break;
         }
 
         /* Case 2: Specific dish is out of stock, but others might be available.
@@ -356,46 +413,125 @@ ask_dish(const simctx_t *ctx, client_t *self, msg_t *msg, msg_t *response) {
                 self->pid, msg->dish.id
             );
 
-            ssize_t      new_id    = -1;
-            const size_t menu_size = ctx->menu[self->loc].size;
+            ssize_t new_slot = -1;
 
-            /* Strategy: Try 10 random picks first for variety. */
+            /* Strategy: Try 10 random picks first for variety, skipping the
+             * dishes the catalog already shows as sold out. */
             for (int k = 0; k < 10; k++) {
-                size_t r       = (size_t)rand() % menu_size;
-                size_t real_id = ctx->menu[self->loc].data[r].id;
-                if (real_id < MAX_ELEMENTS && !tried[real_id]) {
-                    new_id = (ssize_t)real_id;
+                size_t r = (size_t)rand() % menu_size;
+                if (!tried[r] && menu_slot(g_menu, type, r)->quantity > 0) {
+                    new_slot = (ssize_t)r;
                     break;
                 }
             }
 
             /* If random picks failed, perform a linear search for any remaining
              * dish. */
-            if (new_id == -1) {
+            if (new_slot == -1) {
                 for (size_t i = 0; i < menu_size; i++) {
-                    size_t real_id = ctx->menu[self->loc].data[i].id;
-                    if (real_id < MAX_ELEMENTS && !tried[real_id]) {
-                        new_id = (ssize_t)real_id;
+                    if (!tried[i]) {
+                        new_slot = (ssize_t)i;
                         break;
                     }
                 }
             }
 
             /* No alternatives left. */
-            if (new_id == -1) {
+            if (new_slot == -1) {
                 zprintf(
                     ctx->sem[out],
                     "CLIENT %d: Tried all dishes in category %d, giving up.\n",
                     self->pid, self->loc
                 );
-                return false;
+                break;
             }
 
             /* Update request and retry. */
-            msg->dish.id  = (size_t)new_id;
-            tried[new_id] = true;
+            msg->dish.id     = menu_slot(g_menu, type, new_slot)->info.id;
+            tried[new_slot] = true;
 
-        } else return false;
+        } else break;
     }
-    return false;
+
+    free(tried);
+    return got;
+}
+
+/**
+ * @brief Pays at the checkout together with the rest of the group.
+ * * Every member adds its bill and tray to the group totals; the last one to
+ * arrive sends a single payment for all of them and, once it is settled,
+ * releases the others with one futex wake. Members that collected nothing still
+ * take part in the barrier but leave without eating.
+ *
+ * @param ctx       Simulation context.
+ * @param self      Current client state.
+ * @param msg       Checkout request, price and ticket already set.
+ * @param response  Message structure for the worker response.
+ * @param collected Dishes on the client's tray.
+ * @param group     The group this client belongs to.
+ * @return true if the client goes on to the tables.
+ */
+static bool
+pay_for_group(
+    const simctx_t  *ctx,
+    const client_t  *self,
+    msg_t           *msg,
+    msg_t           *response,
+    const size_t     collected,
+    struct groups_t *group
+) {
+    /* Totals are added before arriving, the last arrival sees all of them */
+    __atomic_add_fetch(&group->pay_price, msg->price, __ATOMIC_RELAXED);
+    if (self->ticket) {
+        __atomic_add_fetch(&group->pay_ticket_price, msg->price, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&group->pay_tickets, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_add_fetch(&group->pay_items, collected, __ATOMIC_RELAXED);
+
+    bool           last;
+    const uint32_t gen  = group_arrive(group, &last);
+    msg_t          bill = *msg;
+    if (last) {
+        bill.price            = group->pay_price;
+        bill.pay.ticket_price = group->pay_ticket_price;
+        bill.pay.members      = group->total_members;
+        bill.body             = BODY_GROUP_PAY;
+        bill.ticket           = group->pay_tickets > 0;
+        bill.items = (uint8_t)(group->pay_items < UINT8_MAX ? group->pay_items
+                                                            : UINT8_MAX);
+        bill.mtype = request_mtype(
+            ctx->config.queue_discipline[CHECKOUT], bill.ticket, group->pay_items
+        );
+
+        group->pay_price        = 0;
+        group->pay_ticket_price = 0;
+        group->pay_items        = 0;
+        group->pay_tickets      = 0;
+    }
+
+    if (last) {
+        /* One transaction for the whole group, then one wakeup for all */
+        if (bill.items > 0) {
+            send_msg(self->msgq, bill, sizeof(msg_t) - sizeof(long));
+            recive_msg(self->msgq, self->pid, response);
+        }
+        group_release(group);
+    } else {
+        /* Wait for the last member to pay for everyone */
+        while (group_wait(ctx, group, gen) == -1 && errno == EINTR &&
+               __atomic_load_n(&group->generation, __ATOMIC_ACQUIRE) == gen)
+            ;
+    }
+
+    if (collected == 0) {
+        zprintf(
+            ctx->sem[out],
+            "CLIENT %d: Fasting (nothing left or gave up), exiting.\n",
+            self->pid
+        );
+        return false;
+    }
+
+    return true;
 }
@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include "cJSON.h"
@@ -17,7 +18,157 @@
         } else \
             panic("ERROR: Unknown config format, around key: %s\n", key); \
     } while(0)
+
+/* Like PARSE_INT, but a missing key falls back to `def` */
+#define PARSE_INT_OR(json, key, field, def) \
+    do { \
+        cJSON *item = cJSON_GetObjectItemCaseSensitive(json, key); \
+        if (item == NULL) { \
+            conf->field = (def); \
+        } else if (cJSON_IsNumber(item)) { \
+            conf->field = item->valueint; \
+        } else \
+            panic("ERROR: Unknown config format, around key: %s\n", key); \
+    } while(0)
     
+/**
+ * Reads the optional SKILL_MATRIX: one row per station with a 0/1 for each
+ * station a worker of that row may serve. Without it, stealing (if enabled)
+ * is allowed between every station.
+ */
+static void
+load_skills(const cJSON *json, conf_t *conf) {
+    const cJSON *matrix = cJSON_GetObjectItemCaseSensitive(json, "SKILL_MATRIX");
+
+    it(i, 0, NOF_STATIONS) it(j, 0, NOF_STATIONS) {
+        conf->skills[i][j] = (i == j) || (matrix == NULL && conf->work_stealing);
+    }
+    if (matrix == NULL)
+        return;
+
+    if (!cJSON_IsArray(matrix) || cJSON_GetArraySize(matrix) != NOF_STATIONS)
+        panic("ERROR: SKILL_MATRIX must be a %dx%d array\n", NOF_STATIONS, NOF_STATIONS);
+
+    it(i, 0, NOF_STATIONS) {
+        const cJSON *row = cJSON_GetArrayItem(matrix, i);
+        if (!cJSON_IsArray(row) || cJSON_GetArraySize(row) != NOF_STATIONS)
+            panic("ERROR: SKILL_MATRIX must be a %dx%d array\n", NOF_STATIONS, NOF_STATIONS);
+
+        it(j, 0, NOF_STATIONS) {
+            const cJSON *cell = cJSON_GetArrayItem(row, j);
+            if (!cJSON_IsNumber(cell))
+                panic("ERROR: Unknown config format, around key: SKILL_MATRIX\n");
+            conf->skills[i][j] = (i == j) || cell->valueint != 0;
+        }
+    }
+}
+
+/**
+ * Checks the optional NOF_WORKERS_* split: none of them, or all of them > 0
+ * and summing to NOF_WORKERS, which sizes the worker segments.
+ */
+static void
+check_roles(const conf_t *conf) {
+    int roles = 0, given = 0;
+    it(i, 0, NOF_STATIONS) {
+        if (conf->nof_wk_roles[i] < 0)
+            panic("ERROR: NOF_WORKERS_* must be >= 0\n");
+        roles += conf->nof_wk_roles[i];
+        given += conf->nof_wk_roles[i] > 0;
+    }
+    if (given != 0 && (given != NOF_STATIONS || roles != conf->nof_workers))
+        panic("ERROR: NOF_WORKERS_* must be all > 0 and sum to NOF_WORKERS (%d)\n",
+              conf->nof_workers);
+}
+
+/**
+ * Adds a point {minute, users per minute} to the arrival profile, points must
+ * come in increasing minute order.
+ */
+static void
+add_arrival_point(conf_t *conf, const double min, const double rate) {
+    const int n = conf->arrival_points;
+
+    if (n == ARRIVAL_MAX_POINTS)
+        panic("ERROR: ARRIVAL_PROFILE has more than %d points\n", ARRIVAL_MAX_POINTS);
+    if (min < 0 || rate < 0 || (n > 0 && min <= conf->arrival_profile[n - 1][0]))
+        panic("ERROR: ARRIVAL_PROFILE point %d: minutes must increase, rates be >= 0\n", n);
+
+    conf->arrival_profile[n][0] = min;
+    conf->arrival_profile[n][1] = rate;
+    conf->arrival_points++;
+}
+
+/**
+ * Reads the optional arrival process. ARRIVAL_RATE is a constant rate,
+ * ARRIVAL_PROFILE a piecewise-linear one, either an array of [minute, rate]
+ * pairs or the path of a CSV file with a "minute,rate" pair per line (lines
+ * that do not start with a number, like a header, are skipped). Without
+ * either, every group enters at the start of the day.
+ */
+static void
+load_arrivals(const cJSON *json, conf_t *conf) {
+    const cJSON *rate    = cJSON_GetObjectItemCaseSensitive(json, "ARRIVAL_RATE");
+    const cJSON *profile = cJSON_GetObjectItemCaseSensitive(json, "ARRIVAL_PROFILE");
+
+    conf->arrival_points = 0;
+    if (rate && profile)
+        panic("ERROR: ARRIVAL_RATE and ARRIVAL_PROFILE are alternatives\n");
+
+    if (rate) {
+        if (!cJSON_IsNumber(rate) || rate->valuedouble <= 0)
+            panic("ERROR: ARRIVAL_RATE must be a number > 0\n");
+        add_arrival_point(conf, 0, rate->valuedouble);
+    } else if (cJSON_IsArray(profile)) {
+        const cJSON *pt;
+        cJSON_ArrayForEach(pt, profile) {
+            const cJSON *min = cJSON_GetArrayItem(pt, 0);
+            const cJSON *val = cJSON_GetArrayItem(pt, 1);
+            if (!cJSON_IsArray(pt) || !cJSON_IsNumber(min) || !cJSON_IsNumber(val))
+                panic("ERROR: ARRIVAL_PROFILE must be a list of [minute, rate]\n");
+            add_arrival_point(conf, min->valuedouble, val->valuedouble);
+        }
+    } else if (cJSON_IsString(profile)) {
+        FILE  *file = zfopen(profile->valuestring, "r");
+        char   line[128];
+        double min, val;
+        while (fgets(line, sizeof(line), file)) {
+            if (sscanf(line, "%lf ,%lf", &min, &val) == 2)
+                add_arrival_point(conf, min, val);
+        }
+        fclose(file);
+    } else if (profile) {
+        panic("ERROR: Unknown config format, around key: ARRIVAL_PROFILE\n");
+    }
+
+    if (profile && conf->arrival_points == 0)
+        panic("ERROR: ARRIVAL_PROFILE has no points\n");
+}
+
+/**
+ * Reads an optional queue discipline name ("fifo", "priority", "aging",
+ * "wfq", "sesf"), falling back to `def` when the key is missing.
+ */
+static queue_discipline_t
+parse_discipline(const cJSON *json, const char *key, queue_discipline_t def) {
+    static const char *names[NOF_QD] = {
+        [QD_FIFO] = "fifo", [QD_PRIORITY] = "priority", [QD_AGING] = "aging",
+        [QD_WFQ] = "wfq",   [QD_SESF] = "sesf",
+    };
+
+    const cJSON *item = cJSON_GetObjectItemCaseSensitive(json, key);
+    if (item == NULL)
+        return def;
+
+    if (cJSON_IsString(item)) {
+        it(i, 0, NOF_QD) {
+            if (strcmp(item->valuestring, names[i]) == 0)
+                return (queue_discipline_t)i;
+        }
+    }
+    panic("ERROR: Unknown config format, around key: %s\n", key);
+    return def;
+}
 
 static void
 load_config(
@@ -104,6 +255,12 @@ load_config(
     PARSE_INT(json, "NOF_WK_SEATS_CASSA",   nof_wk_seats[CHECKOUT]);
     assert(conf->nof_wk_seats[CHECKOUT] > 0 && "NOF_WK_SEATS_CASSA must be > 0");
 
+    PARSE_INT_OR(json, "NOF_WORKERS_PRIMI",   nof_wk_roles[FIRST_COURSE], 0);
+    PARSE_INT_OR(json, "NOF_WORKERS_SECONDI", nof_wk_roles[MAIN_COURSE],  0);
+    PARSE_INT_OR(json, "NOF_WORKERS_COFFEE",  nof_wk_roles[COFFEE_BAR],   0);
+    PARSE_INT_OR(json, "NOF_WORKERS_CASSA",   nof_wk_roles[CHECKOUT],     0);
+    check_roles(conf);
+
     PARSE_INT(json, "NOF_TABLE_SEATS",      nof_tbl_seats);
     assert(conf->nof_tbl_seats > 0 && "NOF_TABLE_SEATS must be > 0");
 
@@ -130,6 +287,61 @@ load_config(
     PARSE_INT(json, "N_NEW_USERS",          n_new_users);
     assert(conf->n_new_users >= 0 && "N_NEW_USERS must be >= 0");
 
+    PARSE_INT_OR(json, "REBALANCE_INTERVAL", rebalance_interval, 0);
+    assert(conf->rebalance_interval >= 0 && "REBALANCE_INTERVAL must be >= 0");
+
+    PARSE_INT_OR(json, "ADAPTIVE_STAFFING",  adaptive_staffing,  0);
+    assert(conf->adaptive_staffing >= 0 && conf->adaptive_staffing <= 1 &&
+           "ADAPTIVE_STAFFING must be 0 or 1");
+
+    PARSE_INT_OR(json, "WORK_STEALING",      work_stealing,      0);
+    load_skills(json, conf);
+
+    PARSE_INT_OR(json, "AUTOSCALE_BUDGET",   autoscale_budget,   0);
+    assert(conf->autoscale_budget >= 0 && "AUTOSCALE_BUDGET must be >= 0");
+
+    PARSE_INT_OR(json, "AUTOSCALE_INTERVAL", autoscale_interval, 5);
+    assert(conf->autoscale_interval > 0 && "AUTOSCALE_INTERVAL must be > 0");
+
+    PARSE_INT_OR(json, "AUTOSCALE_BACKLOG",  autoscale_backlog,  3);
+    assert(conf->autoscale_backlog > 0 && "AUTOSCALE_BACKLOG must be > 0");
+
+    PARSE_INT_OR(json, "AUTOSCALE_P95_WAIT", autoscale_p95_wait, 0);
+    assert(conf->autoscale_p95_wait >= 0 && "AUTOSCALE_P95_WAIT must be >= 0");
+
+    PARSE_INT_OR(json, "BREAK_POLICY",       break_policy,       1);
+    assert(conf->break_policy >= 0 && conf->break_policy <= 1 &&
+           "BREAK_POLICY must be 0 (random) or 1 (load aware)");
+
+    conf->queue_discipline[FIRST_COURSE] = parse_discipline(json, "QUEUE_PRIMI",   QD_FIFO);
+    conf->queue_discipline[MAIN_COURSE]  = parse_discipline(json, "QUEUE_SECONDI", QD_FIFO);
+    conf->queue_discipline[COFFEE_BAR]   = parse_discipline(json, "QUEUE_COFFEE",  QD_FIFO);
+    conf->queue_discipline[CHECKOUT]     = parse_discipline(json, "QUEUE_CASSA",   QD_PRIORITY);
+
+    /* Food requests are one dish each: SESF would be plain FIFO there */
+    it(i, 0, CHECKOUT) {
+        if (conf->queue_discipline[i] == QD_SESF)
+            panic("ERROR: sesf only applies to QUEUE_CASSA, food requests "
+                  "are one dish each\n");
+    }
+    PARSE_INT_OR(json, "CHECKOUT_BY_ITEMS", checkout_by_items,
+                 conf->queue_discipline[CHECKOUT] == QD_SESF);
+    assert(conf->checkout_by_items >= 0 && conf->checkout_by_items <= 1 &&
+           "CHECKOUT_BY_ITEMS must be 0 or 1");
+
+    PARSE_INT_OR(json, "QUEUE_AGING_MINUTES",      aging_minutes,  15);
+    assert(conf->aging_minutes > 0 && "QUEUE_AGING_MINUTES must be > 0");
+
+    PARSE_INT_OR(json, "QUEUE_WFQ_TICKET_WEIGHT",  wfq_weight[0],  3);
+    assert(conf->wfq_weight[0] > 0 && "QUEUE_WFQ_TICKET_WEIGHT must be > 0");
+
+    PARSE_INT_OR(json, "QUEUE_WFQ_DEFAULT_WEIGHT", wfq_weight[1],  1);
+    assert(conf->wfq_weight[1] > 0 && "QUEUE_WFQ_DEFAULT_WEIGHT must be > 0");
+
+    PARSE_INT_OR(json, "GROUP_CHECKOUT",           group_checkout, 0);
+
+    load_arrivals(json, conf);
+
     cJSON_Delete(json);
     free(json_content);
 }
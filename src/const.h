@@ -6,18 +6,21 @@
 #define MAX_DISHES 3
 #define DISCOUNT_DISH 12
 #define MAX_TOTAL_USERS 1000
+#define ARRIVAL_MAX_POINTS 64 /* points of an arrival rate profile */
+#define TRACE_PID_SLOTS 2048  /* pid -> client hash of a trace, > 2x users */
 
-/* =================== DISH MAX =================== */
-#define MAX_MAIN 10
-#define MAX_FIRST 10
-#define MAX_COFFEE 10
-
-#define MAX_ELEMENTS 10
+/* =================== MENU =================== */
+#define MENU_CATEGORIES 3
+#define MAX_DISH_ID 65535 /* upper bound for ids, keeps the id index dense */
 
 /* =================== SIM. DURATION =================== */
 #define WORK_DAY_MINUTES 480 /* 8h */
 #define N_NANO_SECS 10000000 /* old: 5, number of real ns for a minute in the sim */
 #define TO_NANOSEC 1000000000L
+/* Wait histograms: one bucket per minute up to WAIT_LINEAR_BUCKETS, then
+ * every 8 buckets double their width (up to ~17h, last = overflow) */
+#define WAIT_BUCKETS 64
+#define WAIT_LINEAR_BUCKETS 16
 
 /* =================== AVERAGE TIMES =================== */
 static unsigned long var_srvc[] = {
@@ -28,11 +31,18 @@ static unsigned long var_srvc[] = {
     20, // VAR_SRVC_REFILL 
 };
 
+/* =================== QUEUES =================== */
+#define REQ_CLASSES 2     /* 0 = ticket holders, 1 = everyone else */
+#define WFQ_STRIDE 1000   /* pass added per request is WFQ_STRIDE / weight */
+
+/* ====================== BREAKS ===================== */
+#define BREAK_RANDOM_CHANCE 15  /* % per client with BREAK_POLICY 0 */
+#define BREAK_DEADLINE_SLACK 10 /* spare minutes kept per remaining break */
+
 /* ====================== SIM DATA ===================== */
-#define DISHES_COUNT 10
 #define REFILL_INTERVAL 10
 
-#define DASHBOARD_UPDATE_RATE 30
+#define DASHBOARD_UPDATE_RATE 5
 #define TUI_NOTIFICATIONS_LEN 10
 
 #endif
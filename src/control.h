@@ -0,0 +1,208 @@
+#ifndef _CONTROL_H
+#define _CONTROL_H
+
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "objects.h"
+#include "tools.h"
+
+/* =========================================================================
+ * Control socket
+ * The coordinator listens on <run dir>/control.sock. A client connects,
+ * sends one command line and reads back one reply line, "OK ..." or
+ * "ERR ...". Commands are collected without blocking once per simulated
+ * minute and handled together, and while the coordinator waits for a day to
+ * drain; a command waiting in the listen backlog is picked up at the next
+ * poll. A disorder started between two days begins at the next opening, a
+ * running one is suspended at closing and goes on the day after. The socket
+ * is closed as soon as the simulation ends.
+ *
+ *   add-users N           spawn N users in the running day
+ *   start-disorder [D]    block the checkout for D minutes (default config)
+ *   stats                 current day metrics
+ *   set-param KEY VALUE   change a policy knob of the config at run time
+ * ========================================================================= */
+
+#define CTL_SOCK "control.sock"
+#define CTL_MAX_CONN 16
+#define CTL_LINE_MAX 256
+/* How long a client waits for the reply, the coordinator may be between
+ * two days */
+#define CTL_TIMEOUT_MS 5000
+
+/* Builds the reply to cmd, which is a line without the newline */
+typedef void (*ctl_handler_t)(
+    simctx_t *ctx, char *cmd, char *reply, size_t len
+);
+
+/* Server side, lives in the coordinator */
+static struct {
+    int    fd;
+    int    conn[CTL_MAX_CONN]; // -1 = free
+    char   buf[CTL_MAX_CONN][CTL_LINE_MAX];
+    size_t len[CTL_MAX_CONN];
+} g_ctl = {.fd = -1};
+
+/**
+ * @brief Fills addr with the socket path of the current run directory.
+ */
+static inline void
+ctl_addr(struct sockaddr_un *addr) {
+    const char *path = run_path(CTL_SOCK);
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path))
+        panic("ERROR: Control socket path too long: %s\n", path);
+    strcpy(addr->sun_path, path);
+}
+
+/**
+ * @brief Creates the listening socket, replacing a stale one.
+ * * The socket is close-on-exec, so workers and clients do not keep it.
+ */
+static inline void
+ctl_listen(void) {
+    struct sockaddr_un addr;
+    ctl_addr(&addr);
+    unlink(addr.sun_path);
+
+    g_ctl.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (g_ctl.fd == -1 ||
+        bind(g_ctl.fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+        listen(g_ctl.fd, SOMAXCONN) == -1)
+        panic("ERROR: Unable to open the control socket %s\n", addr.sun_path);
+
+    it(i, 0, CTL_MAX_CONN) g_ctl.conn[i] = -1;
+}
+
+/**
+ * @brief Accepts the pending clients and answers every complete command.
+ * * Never blocks: a client whose line is not complete yet keeps its slot and
+ * is read again at the next call.
+ * @return Number of commands handled.
+ */
+static inline size_t
+ctl_poll(simctx_t *ctx, ctl_handler_t handler) {
+    size_t handled = 0;
+
+    if (g_ctl.fd == -1)
+        return 0;
+
+    it(i, 0, CTL_MAX_CONN) {
+        if (g_ctl.conn[i] != -1)
+            continue;
+        g_ctl.conn[i] = accept4(g_ctl.fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        g_ctl.len[i]  = 0;
+        if (g_ctl.conn[i] == -1)
+            break;
+    }
+
+    it(i, 0, CTL_MAX_CONN) {
+        if (g_ctl.conn[i] == -1)
+            continue;
+
+        char         *buf = g_ctl.buf[i];
+        const ssize_t got = recv(
+            g_ctl.conn[i], buf + g_ctl.len[i], CTL_LINE_MAX - 1 - g_ctl.len[i], 0
+        );
+        if (got == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            continue;
+        if (got == -1) {
+            close(g_ctl.conn[i]);
+            g_ctl.conn[i] = -1;
+            continue;
+        }
+        if (got > 0)
+            g_ctl.len[i] += (size_t)got;
+        buf[g_ctl.len[i]] = '\0';
+
+        /* Wait for the whole line, unless the client is done or it's too long */
+        char *nl = strchr(buf, '\n');
+        if (nl == NULL && got > 0 && g_ctl.len[i] < CTL_LINE_MAX - 1)
+            continue;
+
+        char reply[CTL_LINE_MAX];
+        if (nl)
+            *nl = '\0';
+        if (nl == NULL && got > 0)
+            snprintf(reply, sizeof(reply), "ERR command too long");
+        else
+            handler(ctx, buf, reply, sizeof(reply) - 1);
+
+        strcat(reply, "\n");
+        send(g_ctl.conn[i], reply, strlen(reply), MSG_NOSIGNAL);
+        close(g_ctl.conn[i]);
+        g_ctl.conn[i] = -1;
+        handled++;
+    }
+
+    return handled;
+}
+
+/**
+ * @brief Drops the clients still connected and removes the socket.
+ */
+static inline void
+ctl_close(void) {
+    if (g_ctl.fd == -1)
+        return;
+
+    it(i, 0, CTL_MAX_CONN) {
+        if (g_ctl.conn[i] != -1)
+            close(g_ctl.conn[i]);
+    }
+    close(g_ctl.fd);
+    g_ctl.fd = -1;
+    unlink(run_path(CTL_SOCK));
+}
+
+/**
+ * @brief Client side: sends cmd to the coordinator and waits for the reply.
+ * @param cmd Command line, without the newline.
+ * @param reply Output, the reply line without the newline.
+ * @return 0 if the coordinator answered OK, -1 otherwise (reply explains).
+ */
+static inline int
+ctl_request(const char *cmd, char *reply, const size_t len) {
+    struct sockaddr_un addr;
+    ctl_addr(&addr);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        snprintf(reply, len, "ERR simulation not running (%s)", addr.sun_path);
+        if (fd != -1)
+            close(fd);
+        return -1;
+    }
+
+    dprintf(fd, "%s\n", cmd);
+    shutdown(fd, SHUT_WR);
+
+    size_t        got = 0;
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    while (got < len - 1 && poll(&pfd, 1, CTL_TIMEOUT_MS) > 0) {
+        const ssize_t n = read(fd, reply + got, len - 1 - got);
+        if (n <= 0)
+            break;
+        got += (size_t)n;
+    }
+    close(fd);
+
+    reply[got] = '\0';
+    char *nl   = strchr(reply, '\n');
+    if (nl)
+        *nl = '\0';
+
+    if (got == 0) {
+        snprintf(reply, len, "ERR no reply from the simulation");
+        return -1;
+    }
+    return strncmp(reply, "OK", 2) == 0 ? 0 : -1;
+}
+
+#endif
@@ -0,0 +1,86 @@
+#include "dashboard.h"
+#include "tools.h"
+#include "tui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/shm.h>
+#include <unistd.h>
+
+/* Default time between two frames, the simulation does not wait for us */
+#define VIEWER_REFRESH_MS 100
+
+static inline void
+read_shm_id(int *ctx_id) {
+    int   shm_st = -1;
+    FILE *file   = zfopen(run_path("shared"), "r");
+
+    zfscanf(file, "%d, %d", ctx_id, &shm_st);
+    fclose(file);
+
+    if (*ctx_id == -1)
+        panic("ERROR: Context not exist!\n");
+}
+
+/**
+ * Read-only mapping of the context: a viewer can not disturb the simulation.
+ * Bypasses the zshmat cache, which maps read/write.
+ */
+static inline const simctx_t *
+attach_ctx(const int ctx_id) {
+    const void *res = shmat(ctx_id, NULL, SHM_RDONLY);
+    if (res == (void *)-1)
+        panic("ERROR: Shared memory `at` is failed\n");
+
+    return (const simctx_t *)res;
+}
+
+/**
+ * The coordinator removes the context when it exits; our mapping keeps the
+ * segment around, only marked for destruction.
+ */
+static inline bool
+ctx_alive(const int ctx_id) {
+    struct shmid_ds ds;
+    return shmctl(ctx_id, IPC_STAT, &ds) == 0 &&
+           !(ds.shm_perm.mode & SHM_DEST);
+}
+
+int
+main(int argc, char **argv) {
+    long refresh_ms = VIEWER_REFRESH_MS;
+
+    if (argc > 2)
+        panic("Usage: %s [refresh_ms]\n", argv[0]);
+    if (argc == 2 && (refresh_ms = atol(argv[1])) <= 0)
+        panic("ERROR: refresh_ms must be a positive number\n");
+
+    int ctx_id = -1;
+    read_shm_id(&ctx_id);
+    const simctx_t *ctx = attach_ctx(ctx_id);
+
+    size_t rows, cols;
+    get_terminal_size(&rows, &cols);
+    screen *s = init_screen(rows, cols);
+    enableRawMode();
+
+    /* day stays 0 until the coordinator publishes its first minute */
+    snapshot_t snap = {0};
+    while (ctx_alive(ctx_id)) {
+        if (snap_read(ctx, &snap) && snap.day > 0 && !snap.running)
+            break;
+
+        if (snap.day > 0)
+            render_dashboard(s, &snap, "Press [q] to close the viewer.");
+
+        if (s_getch() == 'q')
+            break;
+        usleep((useconds_t)refresh_ms * 1000);
+    }
+
+    shmdt(ctx);
+    reset_terminal();
+    free_screen(s);
+
+    printf("[INFO] Dashboard closed\n");
+    return 0;
+}
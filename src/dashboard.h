@@ -0,0 +1,221 @@
+#ifndef _DASHBOARD_H
+#define _DASHBOARD_H
+
+#include <stdio.h>
+#include <string.h>
+
+#include "const.h"
+#include "objects.h"
+#include "tools.h"
+#include "tui.h"
+
+/* =========================================================================
+ * Dashboard
+ * Drawn only from a snapshot_t, so the coordinator and bin/dashboard share
+ * it and neither touches the live semaphores or stations while rendering.
+ * ========================================================================= */
+
+/**
+ * @brief Renders the real-time simulation dashboard.
+ * * A new arrival is detected by snap->arrivals moving and announced for the
+ * next TUI_NOTIFICATIONS_LEN frames.
+ * * @param s Screen to draw on.
+ * @param snap Metrics published by the coordinator.
+ * @param hint Footer line, tells how to leave this view.
+ */
+static void
+render_dashboard(screen *s, const snapshot_t *snap, const char *hint) {
+    s_clear(s);
+    const size_t W     = s->cols;
+    const size_t H     = s->rows;
+    const size_t mid_x = W / 2;
+    const size_t min   = snap->min;
+
+    static int    notification_timer = 0;
+    static size_t seen_arrivals      = 0;
+
+    if (snap->arrivals != seen_arrivals) {
+        notification_timer = TUI_NOTIFICATIONS_LEN;
+        seen_arrivals      = snap->arrivals;
+    }
+
+    draw_box(s, 0, 0, W, H, COL_GRAY);
+    const char *title = " OASI DEL GOLFO - DASHBOARD ";
+    s_draw_text(s, (W - strlen(title)) / 2, 0, COL_WHITE, title);
+
+    draw_hline(s, 1, 2, W - 2, COL_GRAY);
+    s_draw_text(s, 0, 2, COL_GRAY, BOX_VR);
+    s_draw_text(s, W - 1, 2, COL_GRAY, BOX_VL);
+    s_draw_text(s, mid_x, 2, COL_GRAY, BOX_HD);
+
+    /* Header Info */
+    s_draw_text(s, 2, 1, COL_GRAY, "DAY: ");
+    s_draw_text(s, 10, 1, COL_WHITE, "%zu/%zu", snap->day, snap->days);
+
+    int u_total    = (int)snap->users_total;
+    int u_finished = (int)snap->users_in;
+    int u_inside   = u_total - u_finished;
+
+    if (u_total > 0) {
+        int   bar_w = 20;
+        float pct   = (float)u_inside / (float)u_total;
+        char  count_buf[32];
+        snprintf(count_buf, 32, "%3d/%3d", u_inside, u_total);
+        int count_len = strlen(count_buf);
+
+        int end_x   = W - 2;
+        int count_x = end_x - count_len;
+        int bar_x   = count_x - 1 - bar_w;
+        int label_x = bar_x - 7;
+
+        if (label_x > (int)mid_x) {
+            s_draw_text(s, label_x, 1, COL_GRAY, "Users:");
+            s_draw_bar(s, bar_x, 1, bar_w, pct, COL_WHITE, COL_GRAY);
+            s_draw_text(s, count_x, 1, COL_WHITE, "%s", count_buf);
+        }
+    }
+
+    draw_vline(s, mid_x, 3, H - 4, COL_GRAY);
+    s_draw_text(s, mid_x, H - 1, COL_GRAY, BOX_HU);
+
+    /* Left Column: Flow Statistics */
+    size_t r  = 4;
+    size_t c1 = 2;
+    s_draw_text(s, c1, r++, COL_WHITE, "\u25BA FLOW STATISTICS");
+    r++;
+
+    size_t tot_served = 0;
+    size_t tot_breaks = 0;
+    it(i, 0, NOF_STATIONS) {
+        tot_served += snap->st[i].served;
+        tot_breaks += snap->st[i].breaks;
+    }
+
+    int label_w = 18;
+    s_draw_text(s, c1 + 2, r, COL_GRAY, "Total Served:");
+    s_draw_text(s, c1 + 2 + label_w, r++, COL_WHITE, "%zu", tot_served);
+    s_draw_text(s, c1 + 2, r, COL_GRAY, "Not Served:");
+    s_draw_text(s, c1 + 2 + label_w, r++, COL_WHITE, "%zu", snap->not_served);
+    s_draw_text(s, c1 + 2, r, COL_GRAY, "Seated at Tables:");
+    s_draw_text(s, c1 + 2 + label_w, r++, COL_WHITE, "%zu", snap->seated);
+
+    r += 2;
+    s_draw_text(s, c1, r++, COL_WHITE, "\u25BA ECONOMY & STAFF");
+    r++;
+
+    s_draw_text(s, c1 + 2, r, COL_GRAY, "Revenue:");
+    s_draw_text(
+        s, c1 + 2 + label_w, r++, COL_WHITE, "%zu€", snap->st[CHECKOUT].earnings
+    );
+    s_draw_text(s, c1 + 2, r, COL_GRAY, "Total Breaks:");
+    s_draw_text(s, c1 + 2 + label_w, r++, COL_WHITE, "%zu", tot_breaks);
+
+    /* Right Column: Kitchen & Efficiency */
+    r         = 4;
+    size_t c2 = mid_x + 3;
+    s_draw_text(s, c2, r++, COL_WHITE, "\u25BA KITCHEN STATUS");
+    r++;
+
+    int off_p = 0;
+    int off_s = 14;
+    int off_r = 24;
+    s_draw_text(s, c2 + off_p, r, COL_GRAY, "DISH");
+    s_draw_text(s, c2 + off_s, r, COL_GRAY, "SERVED");
+    s_draw_text(s, c2 + off_r, r, COL_GRAY, "LEFT");
+    r++;
+    draw_hline(s, c2, r++, 32, COL_GRAY);
+
+    const char *labels[] = {"First", "Main", "Coffee"};
+    const int   types[]  = {FIRST_COURSE, MAIN_COURSE, COFFEE_BAR};
+
+    it(i, 0, 3) {
+        int t = types[i];
+        s_draw_text(s, c2 + off_p, r, COL_WHITE, "%s", labels[i]);
+        s_draw_text(s, c2 + off_s, r, COL_WHITE, "%zu", snap->st[t].served);
+        if (t == COFFEE_BAR) {
+            s_draw_text(s, c2 + off_r, r, COL_WHITE, "\u221E");
+        } else {
+            const size_t leftovers = snap->st[t].leftovers;
+            uint8_t col = (leftovers < 10) ? COL_WHITE : COL_GRAY;
+            s_draw_text(s, c2 + off_r, r, col, "%zu", leftovers);
+        }
+        r++;
+    }
+
+    r += 2;
+    s_draw_text(s, c2, r++, COL_WHITE, "\u25BA STATION EFFICIENCY");
+    r++;
+
+    const char *st_names[] = {"First", "Main", "Coffee", "Check"};
+    it(i, 0, NOF_STATIONS) {
+        float avg = snap->st[i].served > 0
+                        ? (float)snap->st[i].worked_time / snap->st[i].served
+                        : 0.0f;
+
+        s_draw_text(s, c2, r, COL_GRAY, "%s:", st_names[i]);
+        s_draw_text(s, c2 + 7, r, COL_WHITE, "%4.0fns", avg);
+        s_draw_text(
+            s, c2 + 17, r, COL_WHITE, "%02zu/%02zu", snap->st[i].active,
+            snap->st[i].cap
+        );
+
+        /* Working first, then the ones on a break */
+        int          bar_x   = c2 + 22;
+        const size_t present = snap->st[i].workers;
+        const size_t paused  = snap->st[i].paused;
+        s_draw_text(s, bar_x, r, COL_GRAY, "[");
+        it(k, 0, present) {
+            if ((size_t)k < present - paused)
+                s_draw_text(s, bar_x + 1 + k, r, COL_WHITE, "\u25A0");
+            else
+                s_draw_text(s, bar_x + 1 + k, r, COL_GRAY, "_");
+        }
+        s_draw_text(s, bar_x + 1 + present, r, COL_GRAY, "]");
+        r++;
+    }
+
+    /* Footer & System Alerts */
+    int footer_y = s->rows - 4;
+    if (notification_timer > 0) {
+        s_draw_text(
+            s, 2, footer_y, COL_GREEN, "!!! %zu NEW CLIENTS ARRIVED !!!",
+            snap->last_arrival
+        );
+        notification_timer--;
+    }
+    s_draw_text(s, 2, H - 2, COL_GRAY, "%s", hint);
+
+    /* Disorder / Glitch UI Effect */
+    int box_x = mid_x + 2;
+    int box_y = H - 2;
+    s_draw_text(s, box_x, box_y, COL_GRAY, "SYS:[");
+    if (snap->disorder) {
+        const char *glitch_chars[] = {"▂", "▃", "▄"};
+        for (int i = 0; i < 15; i++) {
+            if ((min + i) % 7 == 0 && i % 3 == 0)
+                s_draw_text(
+                    s, box_x + 5 + i, box_y, COL_RED, "%s", glitch_chars[i % 3]
+                );
+            else
+                s_draw_text(s, box_x + 5 + i, box_y, COL_RED, "▁");
+        }
+        int blink_state = (min / 2) % 4;
+        if (blink_state == 0 || blink_state == 2)
+            s_draw_text(s, box_x + 24, box_y, COL_RED, "!ALERT!");
+    } else {
+        const char *pattern[] = {"▂", "▂", "▃", "▃", "▄", "▄", "▅", "▅",
+                                 "▆", "▆", "▇", "▇", "▇", "▆", "▆", "▅",
+                                 "▅", "▄", "▄", "▃", "▃", "▂", "▂"};
+        for (int i = 0; i < 16; i++) {
+            int idx = ((min * 2) + i) % 23;
+            s_draw_text(s, box_x + 5 + i, box_y, COL_GREEN, "%s", pattern[idx]);
+        }
+    }
+    s_draw_text(s, box_x + 21, box_y, COL_GRAY, "]");
+
+    s_draw_text(s, W - 1, 0, COL_GRAY, BOX_TR);
+    s_draw_text(s, W - 1, H - 1, COL_GRAY, BOX_BR);
+    s_display(s);
+}
+
+#endif
@@ -1,89 +1,28 @@
-#include "tools.h"
+#include "control.h"
 #include <stdio.h>
-#include <unistd.h>
-#include <signal.h>
-
-static sem_t g_sem_disorder = -1;
-static simctx_t *g_ctx = NULL;
-
-static inline void
-cleanup_and_exit(int sig) {
-    (void)sig;
-    if (g_ctx && g_sem_disorder != -1) {
-
-        if (g_ctx->is_disorder_active) {
-            g_ctx->is_disorder_active = false;
-			sem_signal(g_sem_disorder);
-
-            const char msg[] = "\n[DISORDER] Interrotto! Ripristino stato.\n";
-            write(STDERR_FILENO, msg, sizeof(msg) - 1);
-        }
-    }
-
-    exit(0);
-}
-
-static inline void
-read_shm_id(int *ctx_id, int *shm_st) {
-    FILE *file = zfopen("data/shared", "r");
-
-    zfscanf(file, "%d, %d", ctx_id, shm_st);
-
-    if (*ctx_id == -1 || *shm_st == -1) {
-        fclose(file);
-        panic("ERROR: Context not exist!\n");
-    }
-
-    fclose(file);
-}
+#include <stdlib.h>
 
+/*
+ * Asks the coordinator to block the checkout. The coordinator holds the
+ * disorder semaphore and releases it by itself once the minutes are over,
+ * so nothing is left blocked if this process is interrupted.
+ */
 int
-main(void) {
-    int ctx_id = -1, shm_st = -1;
-
-	struct sigaction sa;
-    sa.sa_handler = cleanup_and_exit;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = 0;
-    sigaction(SIGINT, &sa, NULL);
-    sigaction(SIGTERM, &sa, NULL);
-
-    read_shm_id(&ctx_id, &shm_st);
-    simctx_t *ctx = get_ctx(ctx_id);
-
-	g_ctx = ctx;
-    g_sem_disorder = ctx->sem[disorder];
-
-    if (ctx->is_disorder_active) {
-        printf("[DISORDER] Errore: Disordine gia' in corso!\n");
+main(int argc, char **argv) {
+    if (argc > 2)
+        panic("Usage: %s [minutes]\n", argv[0]);
+
+    char cmd[CTL_LINE_MAX], reply[CTL_LINE_MAX];
+    if (argc == 2)
+        snprintf(cmd, sizeof(cmd), "start-disorder %d", atoi(argv[1]));
+    else
+        snprintf(cmd, sizeof(cmd), "start-disorder");
+
+    if (ctl_request(cmd, reply, sizeof(reply)) == -1) {
+        printf("[DISORDER] Errore: %s\n", reply);
         return 1;
     }
 
-    printf("[INFO] Disorder started\n\n");
-    ctx->is_disorder_active = true;
-
-    int res;
-    do {
-        res = sem_wait(g_sem_disorder);
-    } while (res == -1 && errno == EINTR);
-
-    if (res == -1) {
-        perror("[DISORDER] Errore critico in sem_wait");
-        ctx->is_disorder_active = false;
-        return 1;
-    }
-
-    size_t value = sem_getval(g_sem_disorder);
-    printf("[INFO] Current wait Value %zu\n", value);
-
-    znsleep(ctx->config.disorder_duration);
-
-    ctx->is_disorder_active = false;
-    sem_signal(g_sem_disorder);
-
-    value = sem_getval(g_sem_disorder);
-	printf("[INFO] Current signal value %zu\n", value);
-
-    printf("\n[INFO] End disorder executable.\n");
+    printf("[INFO] Disorder started: %s\n", reply);
     return 0;
 }
@@ -1,4 +1,5 @@
 #include <signal.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,35 +10,121 @@
 #include <sys/msg.h>
 #include <sys/sem.h>
 #include <sys/shm.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 
+#include "arrivals.h"
+#include "checkpoint.h"
+#include "cJSON.h"
 #include "config.h"
 #include "const.h"
+#include "control.h"
+#include "dashboard.h"
 #include "menu.h"
+#include "model.h"
 #include "objects.h"
+#include "policy.h"
 #include "tools.h"
+#include "trace.h"
 #include "tui.h"
 
 /* =================================================================
  * Global State & Signal Flags
  * ================================================================= */
 
-static int g_priority_list[4];
-
 /**
- * @brief Global structure to track client process IDs for cleanup.
+ * @brief Client process IDs, kept for diagnostics: signals go to g_pgid.
+ * Group and ticket of every client, by spawn index, go in the checkpoints.
  */
 static struct {
-    pid_t *id;
-    size_t cnt;
+    pid_t  *id;
+    size_t *group;
+    bool   *ticket;
+    size_t  cnt;
 } g_client_pids;
 
-volatile sig_atomic_t g_users_req =
-    0; /**< Flag set by SIGUSR2 for dynamic user addition. */
 volatile sig_atomic_t g_stop_req =
     0; /**< Flag set by SIGINT/SIGTERM for graceful shutdown. */
 static shmid_t g_shmid =
     0; /**< Shared memory ID used to pass context to clients. */
+static menu_t *g_menu = NULL; /**< Dish catalog, attached once by init_ctx. */
+static shmid_t g_st_shmid =
+    0; /**< Stations segment, handed to the elastic workers. */
+static sem_pool_t g_sem_pool; /**< Semaphores that live for the whole run. */
+static sem_pool_t g_day_pool; /**< Semaphores recreated every day. */
+static snapshot_t g_snap; /**< Last metrics published, drawn in-process too. */
+static int g_users_left = 0; /**< Users still inside when the last day ended. */
+static size_t g_pending_users = 0; /**< Asked by add-users, spawned next tick. */
+static size_t g_disorder_left = 0; /**< Minutes left of a running disorder. */
+
+/** @brief Station names in the JSON outputs. */
+static const char *g_station_keys[NOF_STATIONS] = {
+    "first_course", "main_course", "coffee_bar", "checkout"
+};
+
+/**
+ * @brief Config fields set-param may change while the simulation runs: the
+ * policy knobs, nothing that sizes shared memory, the roster or the groups.
+ */
+static const struct {
+    const char *key;
+    size_t      offset;
+    int         min;
+    int         max;
+} g_params[] = {
+    {"OVERLOAD_THRESHOLD", offsetof(conf_t, overload_threshold), 1, INT_MAX},
+    {"N_NEW_USERS", offsetof(conf_t, n_new_users), 0, INT_MAX},
+    {"DISORDER_DURATION", offsetof(conf_t, disorder_duration), 1, INT_MAX},
+    {"AVG_REFILL_PRIMI", offsetof(conf_t, avg_refill[0]), 0, INT_MAX},
+    {"AVG_REFILL_SECONDI", offsetof(conf_t, avg_refill[1]), 0, INT_MAX},
+    {"MAX_PORZIONI_PRIMI", offsetof(conf_t, max_porzioni[0]), 0, INT_MAX},
+    {"MAX_PORZIONI_SECONDI", offsetof(conf_t, max_porzioni[1]), 0, INT_MAX},
+    {"AVG_REFILL_TIME", offsetof(conf_t, avg_refill_time), 1, INT_MAX},
+    {"REBALANCE_INTERVAL", offsetof(conf_t, rebalance_interval), 0, INT_MAX},
+    {"ADAPTIVE_STAFFING", offsetof(conf_t, adaptive_staffing), 0, 1},
+    {"AUTOSCALE_INTERVAL", offsetof(conf_t, autoscale_interval), 1, INT_MAX},
+    {"AUTOSCALE_BACKLOG", offsetof(conf_t, autoscale_backlog), 0, INT_MAX},
+    {"AUTOSCALE_P95_WAIT", offsetof(conf_t, autoscale_p95_wait), 0, INT_MAX},
+    {"BREAK_POLICY", offsetof(conf_t, break_policy), 0, 1},
+    {"QUEUE_AGING_MINUTES", offsetof(conf_t, aging_minutes), 1, INT_MAX},
+    {"QUEUE_WFQ_TICKET_WEIGHT", offsetof(conf_t, wfq_weight[0]), 1, INT_MAX},
+    {"QUEUE_WFQ_DEFAULT_WEIGHT", offsetof(conf_t, wfq_weight[1]), 1, INT_MAX},
+};
+
+/**
+ * @brief Command line options, see parse_args.
+ */
+static struct {
+    const char *conf_path;
+    const char *run_dir;  /**< Overrides SIM_RUN_DIR, NULL = inherited. */
+    bool        headless; /**< No TUI: JSON summary on stdout, exit code. */
+    trace_mode_t trace_mode; /**< --record or --replay. */
+    const char  *trace_path;
+    const char  *resume_path; /**< Checkpoint to go on from, NULL = none. */
+    bool         conf_given;  /**< Config on the command line, wins over the
+                                   checkpoint's one. */
+    bool         seed_given;
+    uint32_t     seed; /**< Seed of the run, from time and pid if not given. */
+    bool         estimate; /**< Print the queueing model estimate and exit. */
+} g_args = {.conf_path = "data/default_config.json"};
+
+/**
+ * @brief Process groups of the children, led by the first worker and the
+ * first client spawned, so a broadcast is one killpg (0 = not created yet).
+ */
+static struct {
+    pid_t workers;
+    pid_t clients;
+} g_pgid;
+
+/**
+ * @brief Elastic workers started by the autoscaler, indexed by slot past the
+ * roster (pid 0 = free slot).
+ */
+static struct {
+    pid_t   *pid;
+    uint32_t spawned; // avviati finora, il loro flusso di rand()
+} g_elastic;
 
 /* =================================================================
  * Function Prototypes
@@ -47,43 +134,61 @@ static shmid_t g_shmid =
 void
 sim_day(simctx_t *ctx, station *st, size_t day, screen *s, bool *manual_quit);
 int  process_new_users(simctx_t *ctx);
+void handle_command(simctx_t *ctx, char *cmd, char *reply, size_t len);
+void disorder_tick(simctx_t *ctx);
+void disorder_hold(simctx_t *ctx);
+void disorder_suspend(simctx_t *ctx);
+void poll_control(simctx_t *ctx);
 void assign_roles(const simctx_t *ctx, station *st);
 
 /* System Initialization & Teardown */
+bool      parse_args(int argc, char **argv);
+void      open_run_dir(void);
 simctx_t *init_ctx(size_t shm_id, conf_t conf);
 void      release_ctx(shmid_t shmid, simctx_t *ctx);
 station  *init_stations(simctx_t *ctx, size_t shmid);
 void      release_station(station st);
 void      write_shared_data(shmid_t ctx_shm, shmid_t st_shm);
 void      reset_shared_data();
+void      open_day_ipc(simctx_t *ctx, station *st);
+void      close_day_ipc(simctx_t *ctx);
 
 /* Process Management */
 void init_groups(simctx_t *ctx, const shmid_t ctx_shm);
-void init_client(const shmid_t ctx_id, const size_t group_idx);
-void init_worker(
-    const shmid_t ctx_id,
-    const shmid_t st_id,
-    const size_t  idx,
-    const loc_t   role
+void restore_groups(simctx_t *ctx, const shmid_t ctx_shm);
+bool draw_ticket(const simctx_t *ctx);
+void init_client(const shmid_t ctx_id, const size_t group_idx, const bool ticket);
+pid_t init_worker(
+    const shmid_t  ctx_id,
+    const shmid_t  st_id,
+    const size_t   idx,
+    const loc_t    role,
+    const uint32_t spawn
 );
-void release_clients(simctx_t *ctx);
-void kill_all_child(simctx_t *ctx, station *stations, int sig);
+void autoscale(simctx_t *ctx, station *st);
+void reap_elastic(simctx_t *ctx, bool wait_all);
+void charge_elastic(simctx_t *ctx, station *st);
+void join_pgroup(const pid_t pid, pid_t *pgid);
+void kill_all_child(int sig);
 
 /* UI / TUI Components */
 screen *init_scr();
 void    kill_scr(screen *s);
-void    render_dashboard(
-       screen   *s,
-       simctx_t *ctx,
-       station  *st,
-       size_t    day,
-       size_t    min,
-       int       new_clients
-   );
-void render_final_report(screen *s, simctx_t *ctx, station *st, bool stopped);
+void    publish_snapshot(simctx_t *ctx, station *st, size_t day, size_t min);
+run_outcome_t run_outcome(const simctx_t *ctx, bool manual_quit);
+void          render_final_report(
+             screen *s, simctx_t *ctx, station *st, run_outcome_t outcome,
+             size_t days
+         );
+void write_summary(
+    FILE *f, simctx_t *ctx, station *st, run_outcome_t outcome, size_t days,
+    long wall_ms
+);
+void write_estimate(FILE *f, const conf_t *conf, const model_t *model);
+void add_model(cJSON *item, const model_station_t *m);
+double sim_utilization(const station *st, size_t servers, size_t days);
 
 /* Signal Handlers */
-void handler_new_users(int sig);
 void handler_stop(int sig);
 
 /* =================================================================
@@ -99,27 +204,60 @@ main(int argc, char **argv) {
     conf_t conf = {};
 
     /* Argument parsing: load default or provided configuration file */
-    switch (argc) {
-    case 1:
-        load_config("data/default_config.json", &conf);
-        break;
-    case 2:
-        load_config(argv[1], &conf);
-        break;
-    default:
-        fprintf(stderr, "ERROR: Too many arguments provided.\n");
-        fprintf(stderr, "Usage: %s [config_file_path]\n", argv[0]);
+    if (!parse_args(argc, argv)) {
+        fprintf(
+            stderr,
+            "Usage: %s [--headless] [--run-dir dir] "
+            "[--record trace | --replay trace] [--resume checkpoint] "
+            "[--seed n] [--estimate] [config_file_path]\n"
+            "With --record or --replay a client keeps one service time per "
+            "station and day,\nso the run differs from a plain one with the "
+            "same seed.\n",
+            argv[0]
+        );
         return -1;
     }
 
-    /* Clear legacy logs/data files */
-    fclear("data/simulation.log");
-    fclear("data/stats.csv");
+    /* Resuming keeps the population of the checkpoint, and its config unless
+     * another one is given for a what-if run */
+    if (g_args.resume_path)
+        ckpt_load(g_args.resume_path);
+    if (g_args.resume_path && !g_args.conf_given)
+        conf = g_ckpt.config;
+    else
+        load_config(g_args.conf_path, &conf);
+    if (g_args.resume_path)
+        conf.nof_users = (int)g_ckpt.users;
+
+    /* Capacity screen: the queueing model only, no process is started */
+    if (g_args.estimate) {
+        size_t  menu_size[MENU_CATEGORIES];
+        model_t model;
+        menu_sizes(MENU_FILE, menu_size);
+        model_estimate(&conf, menu_size, &model);
+        write_estimate(stdout, &conf, &model);
+        return model.stable ? 0 : RUN_OVERLOAD;
+    }
+
+    open_run_dir();
+    trace_open(g_args.trace_mode, g_args.trace_path, &conf);
+
+    /* Clear legacy logs/data files, going on in the same run directory
+     * keeps them up to the checkpoint's day */
+    if (g_args.resume_path && ckpt_in_run_dir(g_args.resume_path)) {
+        if (truncate(run_path("stats.csv"), g_ckpt.csv_bytes) == -1)
+            fclear(run_path("stats.csv"));
+    } else {
+        fclear(run_path("simulation.log"));
+        fclear(run_path("stats.csv"));
+    }
 
     /* Initialize randomness and UI */
     signal(SIGUSR1, SIG_IGN);
-    srand((unsigned int)time(NULL));
-    screen *screen = init_scr();
+    if (!g_args.seed_given)
+        g_args.seed = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);
+    srand(stream_seed(g_args.seed, 0));
+    screen *screen = g_args.headless ? NULL : init_scr();
 
     /* Setup Signal Handlers for termination */
     struct sigaction sa_stop;
@@ -132,55 +270,118 @@ main(int argc, char **argv) {
     const size_t ctx_shm =
         zshmget(sizeof(simctx_t) + (MAX_TOTAL_USERS * sizeof(struct groups_t)));
     simctx_t *ctx = init_ctx(ctx_shm, conf);
+    ctx->seed     = g_args.seed;
+    trace_attach(ctx);
 
     const size_t st_shm   = zshmget(sizeof(station) * NOF_STATIONS);
     station     *stations = init_stations(ctx, st_shm);
+    zprintf(ctx->sem[out], "MAIN: Seed %u\n", ctx->seed);
 
     /* Export IPC IDs to file for external tool synchronization */
     write_shared_data(ctx_shm, st_shm);
+    ctl_listen();
 
     /* Client Management Init */
-    g_client_pids.id  = zcalloc(ctx->config.nof_users, sizeof(pid_t));
-    g_client_pids.cnt = 0;
+    g_client_pids.id     = zcalloc(ctx->config.nof_users, sizeof(pid_t));
+    g_client_pids.group  = zcalloc(ctx->config.nof_users, sizeof(size_t));
+    g_client_pids.ticket = zcalloc(ctx->config.nof_users, sizeof(bool));
+    g_client_pids.cnt    = 0;
+
+    g_elastic.pid = zcalloc(ctx->config.autoscale_budget + 1, sizeof(pid_t));
 
     /* Spawning Processes */
-    init_groups(ctx, ctx_shm);
+    if (g_args.resume_path) {
+        ckpt_restore(ctx, stations, g_menu);
+        restore_groups(ctx, ctx_shm);
+    } else {
+        init_groups(ctx, ctx_shm);
+    }
+    trace_write_header(ctx);
     assign_roles(ctx, stations);
+    size_t wk_idx = 0;
     it(type, 0, NOF_STATIONS) {
         const size_t cap = stations[type].wk_data.cap;
-        it(k, 0, cap) init_worker(ctx_shm, st_shm, k, (loc_t)type);
+        it(k, 0, cap) init_worker(ctx_shm, st_shm, wk_idx++, (loc_t)type, 0);
     }
 
     /* Simulation Loop: Iterates over simulation days */
-    bool manual_quit;
-    it(i, 0, ctx->config.sim_duration) {
+    struct timespec t_start, t_end;
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+
+    bool   manual_quit = false;
+    /* A checkpoint past SIM_DURATION (shorter config given) runs no day */
+    size_t first_day = g_args.resume_path ? g_ckpt.days : 0;
+    if (first_day > (size_t)ctx->config.sim_duration)
+        first_day = (size_t)ctx->config.sim_duration;
+    size_t days_run = first_day;
+    it(i, first_day, ctx->config.sim_duration) {
         if (!ctx->is_sim_running)
             break;
         sim_day(ctx, stations, i, screen, &manual_quit);
+        days_run++;
     }
+    clock_gettime(CLOCK_MONOTONIC, &t_end);
 
     /* Teardown Phase */
     ctx->is_sim_running = false;
     ctx->is_day_running = false;
 
+    /* External dashboards leave on their own */
+    g_snap.running = false;
+    snap_publish(ctx, &g_snap);
+
+    /* No more commands: clients get an answer at once, not a timeout */
+    ctl_close();
+
     zprintf(ctx->sem[out], "MAIN: Simulation ended\n");
-    render_final_report(screen, ctx, stations, manual_quit);
+    const run_outcome_t outcome = run_outcome(ctx, manual_quit);
+    if (screen)
+        render_final_report(screen, ctx, stations, outcome, days_run);
+    else
+        write_summary(
+            stdout, ctx, stations, outcome, days_run,
+            (t_end.tv_sec - t_start.tv_sec) * 1000 +
+                (t_end.tv_nsec - t_start.tv_nsec) / 1000000
+        );
+
+    struct timespec t_stop, t_reaped;
+    clock_gettime(CLOCK_MONOTONIC, &t_stop);
 
     reset_shared_data();
+    kill_all_child(SIGTERM);
     it(i, 0, NOF_STATIONS) release_station(stations[i]);
 
-    shmdt(stations);
+    zshmdt(st_shm);
     shm_kill(st_shm);
-    release_clients(ctx);
 
     /* Synchronization: Wait for all children to exit */
-    sem_set(ctx->sem[wall], ctx->config.nof_workers + ctx->config.nof_users);
+    day_release_all(ctx);
     while (wait(NULL) > 0)
         ;
 
+    clock_gettime(CLOCK_MONOTONIC, &t_reaped);
+    zprintf(
+        ctx->sem[out], "MAIN: Children stopped in %ld us\n",
+        (t_reaped.tv_sec - t_stop.tv_sec) * 1000000 +
+            (t_reaped.tv_nsec - t_stop.tv_nsec) / 1000
+    );
+
+    free(g_client_pids.id);
+    free(g_client_pids.group);
+    free(g_client_pids.ticket);
+    free(g_elastic.pid);
+    trace_close(ctx);
     release_ctx(ctx_shm, ctx);
-    kill_scr(screen);
-    return 0;
+    if (screen)
+        kill_scr(screen);
+
+    /* Leak check: every segment mapped by the coordinator must be gone */
+    if (zshm_attached() > 0)
+        fprintf(
+            stderr, "WARNING: %zu shared memory segments still attached\n",
+            zshm_attached()
+        );
+    return (int)outcome;
 }
 
 /* =================================================================
@@ -192,7 +393,7 @@ main(int argc, char **argv) {
  * @param ctx Pointer to the shared simulation context.
  * @param stations Array of service stations.
  * @param day The current day index.
- * @param s Pointer to the TUI screen.
+ * @param s Pointer to the TUI screen, NULL when headless.
  * @param manual_quit Output flag to indicate if the user requested a quit.
  */
 void
@@ -204,34 +405,53 @@ sim_day(
 
     zprintf(ctx->sem[out], "MAIN: Day started\n");
 
-    /* Sync Start of Day */
+    /* Fresh queues and seats, nothing is left over from yesterday */
+    open_day_ipc(ctx, stations);
+    disorder_hold(ctx);
+
     sem_wait(ctx->sem[shm]);
-    ctx->is_day_running = true;
+    ctx->current_min = 0;
     sem_signal(ctx->sem[shm]);
 
-    /* Reset barriers for the day */
-    sem_set(ctx->sem[wall], ctx->config.nof_workers + ctx->config.nof_users);
-    sem_set(ctx->sem[wk_end], ctx->config.nof_workers);
-    sem_set(ctx->sem[cl_end], ctx->config.nof_users);
+    /* Reset barriers for the day, a group cut short yesterday starts over */
+    it(i, 0, ctx->config.nof_users) {
+        ctx->groups[i].members_ready    = 0;
+        ctx->groups[i].pay_price        = 0;
+        ctx->groups[i].pay_ticket_price = 0;
+        ctx->groups[i].pay_items        = 0;
+        ctx->groups[i].pay_tickets      = 0;
+    }
+
+    /* Sync Start of Day: one wake for every worker and client, the groups
+     * not admitted yet wait at the door */
+    trace_day_begin(ctx);
+    const uint32_t admitted = arrivals_reset(ctx);
+    day_open(ctx, (uint32_t)ctx->config.nof_workers, admitted);
 
     size_t current_min = 0;
-    size_t next_refill_min =
-        get_service_time(ctx->config.avg_refill_time, var_srvc[4]);
+    size_t next_refill_min = trace_refill(
+        ctx, get_service_time(ctx->config.avg_refill_time, var_srvc[4])
+    );
 
     *manual_quit = false;
 
     /* The Minute-by-Minute Loop */
     while (ctx->is_sim_running && current_min < WORK_DAY_MINUTES) {
+        /* Commands of the last minute, add-users are spawned right after */
+        ctl_poll(ctx, handle_command);
         int n_new = process_new_users(ctx);
+        if (n_new > 0) {
+            g_snap.arrivals++;
+            g_snap.last_arrival = (size_t)n_new;
+        }
+        arrivals_tick(ctx, current_min);
+        publish_snapshot(ctx, stations, day + 1, current_min);
 
-        if (n_new > 0)
-            sem_set(ctx->sem[cl_end], ctx->config.nof_users);
-
-        if (current_min % DASHBOARD_UPDATE_RATE == 0 || n_new > 0)
-            render_dashboard(s, ctx, stations, day + 1, current_min, n_new);
+        if (s && (current_min % DASHBOARD_UPDATE_RATE == 0 || n_new > 0))
+            render_dashboard(s, &g_snap, "Press [q] to terminate simulation.");
 
         /* Handle user input and external signals */
-        char c = s_getch();
+        char c = s ? s_getch() : 0;
         if (c == 'q' || g_stop_req) {
             ctx->is_sim_running = false;
             *manual_quit        = true;
@@ -241,25 +461,54 @@ sim_day(
 
         znsleep(1); // Simulation tick
         current_min++;
+        ctx->current_min = current_min;
+        disorder_tick(ctx);
+
+        it(i, 0, NOF_STATIONS) {
+            const size_t queued = station_backlog(ctx, &stations[i]);
+            if (queued > stations[i].stats.queue_peak)
+                stations[i].stats.queue_peak = queued;
+        }
+
+        /* Intra-day worker reallocation */
+        if (ctx->config.rebalance_interval > 0 &&
+            current_min % ctx->config.rebalance_interval == 0)
+            rebalance_workers(ctx, stations);
+
+        /* Wake idle workers that can steal from a backlogged station */
+        if (ctx->config.work_stealing)
+            nudge_stealers(ctx, stations);
+
+        /* Let idle workers take their breaks in the quiet moments */
+        if (ctx->config.break_policy == 1)
+            nudge_breaks(ctx, stations);
+
+        /* Elastic staffing */
+        if (ctx->config.autoscale_budget > 0) {
+            reap_elastic(ctx, false);
+            charge_elastic(ctx, stations);
+            if (current_min % ctx->config.autoscale_interval == 0)
+                autoscale(ctx, stations);
+        }
 
         /* Handle Periodic Refill of food items */
         if (current_min >= next_refill_min) {
             sem_wait(ctx->sem[shm]);
             it(loc_idx, 0, 2) { // Only for first and main courses
-                dish_avl_t  *elem_avl = ctx->avl_dishes[loc_idx].data;
-                const size_t size_avl = ctx->avl_dishes[loc_idx].size;
+                const size_t size_avl = g_menu->cat[loc_idx].size;
                 const size_t max      = ctx->config.max_porzioni[loc_idx];
                 const size_t refill   = ctx->config.avg_refill[loc_idx];
                 it(j, 0, size_avl) {
-                    size_t *qty = &elem_avl[j].quantity;
+                    size_t *qty = &menu_slot(g_menu, loc_idx, j)->quantity;
                     *qty += refill;
                     if (*qty > max)
                         *qty = max;
                 }
             }
             sem_signal(ctx->sem[shm]);
-            size_t interval =
-                get_service_time(ctx->config.avg_refill_time, var_srvc[4]);
+            size_t interval = trace_refill(
+                ctx, get_service_time(ctx->config.avg_refill_time, var_srvc[4])
+            );
             next_refill_min = current_min + interval;
         }
     }
@@ -267,7 +516,10 @@ sim_day(
     zprintf(ctx->sem[out], "MAIN: Day ended\n");
 
     /* Statistics Update */
-    const int users_inside = sem_getval(ctx->sem[cl_end]);
+    it(i, 0, NOF_STATIONS) stations[i].stats.backlog =
+        station_backlog(ctx, &stations[i]);
+    const int users_inside = (int)ctx->day.users_in;
+    g_users_left           = users_inside;
     if (users_inside > 0)
         ctx->global_stats.users_not_served += users_inside;
 
@@ -286,28 +538,84 @@ sim_day(
         ctx->global_stats.earnings += stations[i].stats.earnings;
         ctx->global_stats.total_breaks += stations[i].stats.total_breaks;
         ctx->global_stats.worked_time += stations[i].stats.worked_time;
+        ctx->global_stats.transfers += stations[i].stats.transfers;
+        ctx->global_stats.stolen += stations[i].stats.stolen;
+        ctx->global_stats.scale_up += stations[i].stats.scale_up;
+        ctx->global_stats.scale_down += stations[i].stats.scale_down;
+        ctx->global_stats.elastic_time += stations[i].stats.elastic_time;
+        ctx->global_stats.forced_breaks += stations[i].stats.forced_breaks;
+        ctx->global_stats.payments += stations[i].stats.payments;
+        ctx->global_stats.stockouts += stations[i].stats.stockouts;
 
         stations[i].total_stats.served_dishes +=
             stations[i].stats.served_dishes;
         stations[i].total_stats.earnings += stations[i].stats.earnings;
         stations[i].total_stats.total_breaks += stations[i].stats.total_breaks;
         stations[i].total_stats.worked_time += stations[i].stats.worked_time;
+        stations[i].total_stats.transfers += stations[i].stats.transfers;
+        stations[i].total_stats.stolen += stations[i].stats.stolen;
+        stations[i].total_stats.scale_up += stations[i].stats.scale_up;
+        stations[i].total_stats.scale_down += stations[i].stats.scale_down;
+        stations[i].total_stats.elastic_time += stations[i].stats.elastic_time;
+        stations[i].total_stats.forced_breaks +=
+            stations[i].stats.forced_breaks;
+        stations[i].total_stats.payments += stations[i].stats.payments;
+        stations[i].total_stats.stockouts += stations[i].stats.stockouts;
+        if (stations[i].stats.queue_peak > stations[i].total_stats.queue_peak)
+            stations[i].total_stats.queue_peak = stations[i].stats.queue_peak;
+
+        it(c, 0, REQ_CLASSES) it(b, 0, WAIT_BUCKETS) {
+            ctx->global_stats.wait_hist[c][b] += stations[i].stats.wait_hist[c][b];
+            stations[i].total_stats.wait_hist[c][b] +=
+                stations[i].stats.wait_hist[c][b];
+        }
     }
 
-    save_stats_csv(ctx, stations, day);
+    size_t roster[NOF_STATIONS];
+    worker_split(&ctx->config, roster);
+    save_stats_csv(ctx, stations, g_menu, day, roster);
+    if (ctx->config.adaptive_staffing)
+        adapt_day(ctx, stations, g_menu);
     it(i, 0, NOF_STATIONS) { memset(&stations[i].stats, 0, sizeof(stats)); }
 
-    ctx->is_day_running = false;
+    /* End of day: sleepers wake on the flag, blocked IPC calls on EIDRM */
+    struct timespec t_close, t_drained;
+    clock_gettime(CLOCK_MONOTONIC, &t_close);
+
+    disorder_suspend(ctx);
+    day_close(ctx);
+    group_cancel_all(ctx);
+    close_day_ipc(ctx);
 
     /* Clean up children for next day or full exit */
     if (*manual_quit || !ctx->is_sim_running) {
-        kill_all_child(ctx, stations, SIGTERM);
+        kill_all_child(SIGTERM);
     } else {
-        kill_all_child(ctx, stations, SIGUSR1);
-        zprintf(ctx->sem[out], "MAIN: Reset day semaphores\n");
-        sem_wait_zero(ctx->sem[wk_end]);
-        sem_wait_zero(ctx->sem[cl_end]);
+        reap_elastic(ctx, true);
+        const uint32_t lost = day_drain(ctx, poll_control);
+        if (lost > 0)
+            zprintf(
+                ctx->sem[out],
+                "MAIN: %u processes did not leave the day (dead or stuck)\n", lost
+            );
+
+        clock_gettime(CLOCK_MONOTONIC, &t_drained);
+        zprintf(
+            ctx->sem[out], "MAIN: Day closed, everyone out in %ld us\n",
+            (t_drained.tv_sec - t_close.tv_sec) * 1000000 +
+                (t_drained.tv_nsec - t_close.tv_nsec) / 1000
+        );
     }
+
+    /* Everyone is out, the draws of the day are final */
+    trace_day_end(ctx, day);
+
+    if (!*manual_quit)
+        ckpt_save(
+            ctx, stations, g_menu, day + 1, g_users_left,
+            g_disorder_left, g_client_pids.group,
+            g_client_pids.ticket
+        );
 }
 
 /**
@@ -315,60 +623,33 @@ sim_day(
  * average service time weights.
  * * The algorithm ensures at least 1 worker per station, then distributes the
  * remaining workers proportionally to how slow the station is (weighted by
- * avg_srvc).
+ * avg_srvc). The split is worker_split, shared with the queueing model.
+ * * Every worker registers again at the opening, at the station roster_role
+ * gives it: yesterday's slots are cleared, the roster may have changed.
  */
 void
 assign_roles(const simctx_t *ctx, station *st) {
-    it(i, 0, NOF_STATIONS) st[i].wk_data.cap = 0;
-
-    const int total_workers = ctx->config.nof_workers;
-
-    /* Ensure baseline coverage: 1 worker per station */
-    it(i, 0, NOF_STATIONS) { st[i].wk_data.cap = 1; }
-
-    int remaining = total_workers - NOF_STATIONS;
-    if (remaining <= 0)
-        return;
-
-    size_t total_srvc_time = 0;
-    it(i, 0, NOF_STATIONS) { total_srvc_time += ctx->config.avg_srvc[i]; }
-
-    if (total_srvc_time == 0)
-        total_srvc_time = 1;
-    int assigned_count = 0;
-
-    /* Proportional distribution */
-    it(type, 0, NOF_STATIONS) {
-        size_t weight        = ctx->config.avg_srvc[type];
-        int    extra_workers = (int)((weight * remaining) / total_srvc_time);
-        st[type].wk_data.cap += extra_workers;
-        assigned_count += extra_workers;
-    }
-
-    /* Assign remaining workers based on priority list */
-    int leftovers = remaining - assigned_count;
-    int p_idx     = 0;
-
-    while (leftovers > 0) {
-        const loc_t target = g_priority_list[p_idx];
-        st[target].wk_data.cap++;
-        leftovers--;
-        p_idx = (p_idx + 1) % NOF_STATIONS;
+    size_t cap[NOF_STATIONS];
+    worker_split(&ctx->config, cap);
+    it(i, 0, NOF_STATIONS) {
+        st[i].wk_data.cap = cap[i];
+        memset(
+            get_workers(st[i].wk_data.shmid), 0,
+            sizeof(worker_t) * wk_slots(&ctx->config)
+        );
     }
 }
 
 /**
- * @brief Checks if a signal was received to add new users and forks new client
- * processes.
+ * @brief Forks the users asked through add-users since the last tick, all
+ * requests of the minute in one batch.
  * @return Number of new users added.
  */
 int
 process_new_users(simctx_t *ctx) {
-    sem_wait(ctx->sem[shm]);
-    int num_new = ctx->added_users;
-    ctx->added_users = 0;    
-    sem_signal(ctx->sem[shm]);
-    
+    int num_new     = (int)g_pending_users;
+    g_pending_users = 0;
+
     if (ctx->config.nof_users + num_new > MAX_TOTAL_USERS) {
         zprintf(ctx->sem[out], "[ERROR] Max users limit reached in SHM!\n");
         return 0;
@@ -377,14 +658,18 @@ process_new_users(simctx_t *ctx) {
     if (num_new <= 0)
         return 0;
 
+    /* The new users take part in the running day */
+    day_join(ctx, (uint32_t)num_new);
+
     zprintf(
         ctx->sem[out], "[MAIN] Request received for %d new users!\n", num_new
     );
 
-    size_t old_count = g_client_pids.cnt;
-    size_t new_total = old_count + num_new;
-    pid_t *new_ptr   = zrealloc(g_client_pids.id, new_total * sizeof(pid_t));
-    g_client_pids.id = new_ptr;
+    size_t old_count     = g_client_pids.cnt;
+    size_t new_total     = old_count + num_new;
+    g_client_pids.id     = zrealloc(g_client_pids.id, new_total * sizeof(pid_t));
+    g_client_pids.group  = zrealloc(g_client_pids.group, new_total * sizeof(size_t));
+    g_client_pids.ticket = zrealloc(g_client_pids.ticket, new_total * sizeof(bool));
     
     it(i, 0, num_new) {
         size_t new_idx = old_count + i;
@@ -392,9 +677,14 @@ process_new_users(simctx_t *ctx) {
         ctx->groups[new_idx].id = new_idx;
         ctx->groups[new_idx].total_members = 1;
         ctx->groups[new_idx].members_ready = 0;
-        ctx->groups[new_idx].sem = sem_init(0);
-
-        init_client(g_shmid, new_idx);
+        ctx->groups[new_idx].generation    = 0;
+        ctx->groups[new_idx].pay_price        = 0;
+        ctx->groups[new_idx].pay_ticket_price = 0;
+        ctx->groups[new_idx].pay_items        = 0;
+        ctx->groups[new_idx].pay_tickets      = 0;
+        ctx->groups[new_idx].arrival          = ARRIVAL_IN;
+
+        init_client(g_shmid, new_idx, draw_ticket(ctx));
     }
 
     sem_wait(ctx->sem[shm]);
@@ -404,10 +694,270 @@ process_new_users(simctx_t *ctx) {
     return num_new;
 }
 
+/**
+ * @brief Executes one command of the control socket (see control.h).
+ * * Runs in the minute loop, between two ticks, so it may touch the
+ * coordinator state freely. add-users only queues the users, they are all
+ * forked by the next process_new_users.
+ * @param ctx Global context.
+ * @param cmd Command line.
+ * @param reply Output, "OK ..." or "ERR ...".
+ * @param len Size of reply.
+ */
+void
+handle_command(simctx_t *ctx, char *cmd, char *reply, size_t len) {
+    char *save = NULL;
+    char *verb = strtok_r(cmd, " \t", &save);
+    char *arg1 = strtok_r(NULL, " \t", &save);
+    char *arg2 = strtok_r(NULL, " \t", &save);
+    char *num  = NULL;
+    long  n    = arg1 ? strtol(arg1, &num, 10) : 0;
+    /* arg1 given but not a whole number, e.g. "5abc" */
+    const bool bad_n = arg1 && *num != '\0';
+
+    if (verb == NULL) {
+        snprintf(reply, len, "ERR empty command");
+    } else if (strcmp(verb, "add-users") == 0) {
+        const size_t total = ctx->config.nof_users + g_pending_users + n;
+        if (bad_n || n <= 0)
+            snprintf(reply, len, "ERR usage: add-users N");
+        else if (total > MAX_TOTAL_USERS)
+            snprintf(reply, len, "ERR at most %d users", MAX_TOTAL_USERS);
+        else {
+            g_pending_users += (size_t)n;
+            snprintf(reply, len, "OK %ld users queued", n);
+        }
+    } else if (strcmp(verb, "start-disorder") == 0) {
+        if (n <= 0)
+            n = ctx->config.disorder_duration;
+        if (n <= 0)
+            n = 1;
+        if (bad_n)
+            snprintf(reply, len, "ERR usage: start-disorder [MINUTES]");
+        else if (g_disorder_left > 0)
+            snprintf(reply, len, "ERR disorder already active");
+        else {
+            g_disorder_left = (size_t)n;
+            if (ctx->is_day_running)
+                disorder_hold(ctx);
+            if (ctx->is_day_running && !ctx->is_disorder_active)
+                snprintf(reply, len, "ERR disorder semaphore unavailable");
+            else {
+                zprintf(ctx->sem[out], "MAIN: Disorder for %ld minutes\n", n);
+                snprintf(
+                    reply, len, "OK disorder for %ld minutes%s", n,
+                    ctx->is_day_running ? "" : " from the next opening"
+                );
+            }
+        }
+    } else if (strcmp(verb, "stats") == 0) {
+        const snapshot_t *snap   = &g_snap;
+        size_t            served = 0, queued = 0;
+        it(i, 0, NOF_STATIONS) {
+            served += snap->st[i].served;
+            queued += snap->st[i].queued;
+        }
+        snprintf(
+            reply, len,
+            "OK day=%zu min=%zu users=%zu inside=%zu served=%zu queued=%zu "
+            "revenue=%zu not_served=%zu disorder=%d",
+            snap->day, snap->min, snap->users_total, snap->users_in, served,
+            queued, snap->st[CHECKOUT].earnings, snap->not_served,
+            snap->disorder
+        );
+    } else if (strcmp(verb, "set-param") == 0) {
+        int p = -1;
+        it(i, 0, sizeof(g_params) / sizeof(g_params[0])) {
+            if (arg1 && strcmp(arg1, g_params[i].key) == 0)
+                p = i;
+        }
+        char      *end   = NULL;
+        const long value = arg2 ? strtol(arg2, &end, 10) : 0;
+
+        if (p == -1)
+            snprintf(reply, len, "ERR usage: set-param KEY VALUE, unknown key");
+        else if (arg2 == NULL || *end != '\0' || value < g_params[p].min ||
+                 value > g_params[p].max)
+            snprintf(
+                reply, len, "ERR %s must be in [%d, %d]", g_params[p].key,
+                g_params[p].min, g_params[p].max
+            );
+        else {
+            int *field = (int *)((char *)&ctx->config + g_params[p].offset);
+            sem_wait(ctx->sem[shm]);
+            const int old = *field;
+            *field        = (int)value;
+            sem_signal(ctx->sem[shm]);
+
+            zprintf(
+                ctx->sem[out], "MAIN: %s set from %d to %ld\n",
+                g_params[p].key, old, value
+            );
+            snprintf(reply, len, "OK %s=%ld (was %d)", g_params[p].key, value, old);
+        }
+    } else {
+        snprintf(reply, len, "ERR unknown command `%s`", verb);
+    }
+}
+
+/**
+ * @brief Ends a disorder started through the control socket once its
+ * minutes have passed, letting the checkout workers through again.
+ */
+void
+disorder_tick(simctx_t *ctx) {
+    if (!ctx->is_disorder_active || --g_disorder_left > 0)
+        return;
+
+    ctx->is_disorder_active = false;
+    sem_signal(ctx->sem[disorder]);
+    zprintf(ctx->sem[out], "MAIN: Disorder over\n");
+}
+
+/**
+ * @brief Blocks the checkout while minutes of disorder are left: at the
+ * opening, or when a disorder is started in the running day.
+ */
+void
+disorder_hold(simctx_t *ctx) {
+    if (g_disorder_left == 0 || ctx->is_disorder_active)
+        return;
+
+    if (sem_wait(ctx->sem[disorder]) == -1) {
+        g_disorder_left = 0;
+        zprintf(ctx->sem[out], "MAIN: Disorder semaphore unavailable\n");
+        return;
+    }
+    ctx->is_disorder_active = true;
+}
+
+/**
+ * @brief Lets the checkout workers through at closing, one blocked on the
+ * disorder semaphore would never leave the day. The minutes left block the
+ * checkout again at the next opening (disorder_hold).
+ */
+void
+disorder_suspend(simctx_t *ctx) {
+    if (!ctx->is_disorder_active)
+        return;
+
+    ctx->is_disorder_active = false;
+    sem_signal(ctx->sem[disorder]);
+    zprintf(
+        ctx->sem[out], "MAIN: Disorder suspended at closing, %zu minutes left\n",
+        g_disorder_left
+    );
+}
+
+/**
+ * @brief Answers the control socket while the day is closed, so a command
+ * sent between two days does not outlast the client's timeout.
+ */
+void
+poll_control(simctx_t *ctx) {
+    ctl_poll(ctx, handle_command);
+}
+
 /* =================================================================
  * System & Process Functions
  * ================================================================= */
 
+/**
+ * @brief Reads the command line into g_args.
+ * * Options may come in any order, at most one configuration file is taken.
+ * @return false on an unknown option or extra arguments.
+ */
+bool
+parse_args(int argc, char **argv) {
+    it(i, 1, argc) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            g_args.headless = true;
+        } else if (strcmp(argv[i], "--run-dir") == 0 && i + 1 < argc) {
+            g_args.run_dir = argv[++i];
+        } else if ((strcmp(argv[i], "--record") == 0 ||
+                    strcmp(argv[i], "--replay") == 0) &&
+                   i + 1 < argc && g_args.trace_mode == TRACE_OFF) {
+            g_args.trace_mode = strcmp(argv[i], "--record") == 0
+                                    ? TRACE_RECORD
+                                    : TRACE_REPLAY;
+            g_args.trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--resume") == 0 && i + 1 < argc) {
+            g_args.resume_path = argv[++i];
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            char *end;
+            const unsigned long seed = strtoul(argv[++i], &end, 10);
+            if (*argv[i] == '\0' || *end != '\0' || seed > UINT32_MAX) {
+                fprintf(stderr, "ERROR: Bad seed `%s`.\n", argv[i]);
+                return false;
+            }
+            g_args.seed       = (uint32_t)seed;
+            g_args.seed_given = true;
+        } else if (strcmp(argv[i], "--estimate") == 0) {
+            g_args.estimate = true;
+        } else if (argv[i][0] == '-' || g_args.conf_given) {
+            fprintf(stderr, "ERROR: Unexpected argument `%s`.\n", argv[i]);
+            return false;
+        } else {
+            g_args.conf_path  = argv[i];
+            g_args.conf_given = true;
+        }
+    }
+
+    /* A trace follows a run from its first day */
+    if (g_args.resume_path && g_args.trace_mode != TRACE_OFF) {
+        fprintf(stderr, "ERROR: --resume can not be used with a trace.\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Prepares the run directory holding the files of this simulation.
+ * * --run-dir wins over an inherited SIM_RUN_DIR; the choice is exported so
+ * workers, clients and the tools launched from the same shell find it. The
+ * directory is created if missing, and refused while the coordinator that
+ * wrote its main.pid is still alive.
+ */
+void
+open_run_dir(void) {
+    if (g_args.run_dir)
+        setenv(RUN_DIR_ENV, g_args.run_dir, 1);
+
+    const char *dir = getenv(RUN_DIR_ENV);
+    if (dir && *dir) {
+        /* mkdir -p: every missing parent first */
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s", dir);
+        for (char *p = path + 1;; p++) {
+            const char c = *p;
+            if (c != '/' && c != '\0')
+                continue;
+
+            *p = '\0';
+            if (mkdir(path, 0755) == -1 && errno != EEXIST)
+                panic("ERROR: Unable to create run directory %s\n", dir);
+            *p = c;
+            if (c == '\0')
+                break;
+        }
+    }
+
+    FILE *f_pid = fopen(run_path("main.pid"), "r");
+    if (f_pid == NULL)
+        return;
+
+    pid_t pid = -1;
+    if (fscanf(f_pid, "%d", &pid) == 1 && pid > 0 && pid != getpid() &&
+        kill(pid, 0) == 0) {
+        fclose(f_pid);
+        panic(
+            "ERROR: Run directory %s is in use by simulation %d\n",
+            dir && *dir ? dir : RUN_DIR_DEFAULT, pid
+        );
+    }
+    fclose(f_pid);
+}
+
 /**
  * @brief Initializes the main simulation context in shared memory.
  */
@@ -419,52 +969,27 @@ init_ctx(const size_t shm_id, const conf_t conf) {
     ctx->is_sim_running = true;
     ctx->config         = conf;
 
-    it(i, 0, NOF_STATIONS) ctx->id_msg_q[i] =
-        zmsgget(IPC_PRIVATE, IPC_CREAT | SHM_RW);
-
-    load_menu("data/menu.json", ctx);
+    ctx->menu_shm = load_menu(MENU_FILE);
+    g_menu        = get_menu(ctx->menu_shm);
 
     /* Initialize food availability */
-    it(loc, 0, 3) {
-        struct available_dishes *dishes = &ctx->avl_dishes[loc];
-        it(i, 0, ctx->menu[loc].size) {
-            dishes->data[i].id = ctx->menu[loc].data[i].id;
+    it(loc, 0, MENU_CATEGORIES) {
+        it(i, 0, g_menu->cat[loc].size) {
+            dish_slot_t *slot = menu_slot(g_menu, loc, i);
             if (loc < COFFEE)
-                dishes->data[i].quantity = ctx->config.avg_refill[loc];
+                slot->quantity = ctx->config.avg_refill[loc];
             else
-                dishes->data[i].quantity = 99999; // Unlimited coffee
-            dishes->size++;
+                slot->quantity = 99999; // Unlimited coffee
         }
     }
 
-    ctx->sem[out]      = sem_init(1);
-    ctx->sem[shm]      = sem_init(1);
-    ctx->sem[disorder] = sem_init(1);
-    ctx->sem[wk_end]   = sem_init(0);
-    ctx->sem[cl_end]   = sem_init(0);
-    ctx->sem[wall]     = sem_init(0);
-    ctx->sem[tbl]      = sem_init(ctx->config.nof_tbl_seats);
-
-    /* Sort stations by service time to establish allocation priority */
-    g_priority_list[0] = FIRST_COURSE;
-    g_priority_list[1] = MAIN_COURSE;
-    g_priority_list[2] = COFFEE_BAR;
-    g_priority_list[3] = CHECKOUT;
-
-    it(i, 0, NOF_STATIONS - 1) {
-        it(j, 0, NOF_STATIONS - i - 1) {
-            const size_t time_a = ctx->config.avg_srvc[g_priority_list[j]];
-            const size_t time_b = ctx->config.avg_srvc[g_priority_list[j + 1]];
-            if (time_a < time_b) {
-                const int temp         = g_priority_list[j];
-                g_priority_list[j]     = g_priority_list[j + 1];
-                g_priority_list[j + 1] = temp;
-            }
-        }
-    }
+    sem_pool_init(&g_sem_pool);
+    ctx->sem[out]      = sem_init(&g_sem_pool, 1);
+    ctx->sem[shm]      = sem_init(&g_sem_pool, 1);
+    ctx->sem[disorder] = sem_init(&g_sem_pool, 1);
+
 
     ctx->is_disorder_active = false;
-    ctx->added_users        = 0;
     return ctx;
 }
 
@@ -473,10 +998,12 @@ init_ctx(const size_t shm_id, const conf_t conf) {
  */
 void
 release_ctx(shmid_t shmid, simctx_t *ctx) {
-    it(i, 0, SEM_CNT) sem_kill(ctx->sem[i]);
-    it(i, 0, ctx->config.nof_users) sem_kill(ctx->groups[i].sem);
-    it(i, 0, NOF_STATIONS) msg_kill((int)ctx->id_msg_q[i]);
-    shmdt(ctx);
+    const shmid_t menu_shm = ctx->menu_shm;
+
+    sem_pool_kill(&g_sem_pool);
+    zshmdt(menu_shm);
+    shm_kill(menu_shm);
+    zshmdt(shmid);
     shm_kill(shmid);
 }
 
@@ -490,52 +1017,156 @@ init_stations(simctx_t *ctx, size_t shmid) {
     memset(st, 0, sizeof(station) * NOF_STATIONS);
 
     it(i, 0, NOF_STATIONS) {
-        st[i].type        = (loc_t)i;
-        st[i].sem         = sem_init(1);
-        st[i].wk_data.sem = sem_init(ctx->config.nof_wk_seats[i]);
+        st[i].type = (loc_t)i;
+        st[i].sem  = sem_init(&g_sem_pool, 1);
         st[i].wk_data.shmid =
-            zshmget(sizeof(worker_t) * ctx->config.nof_workers);
-
-        if (i < CHECKOUT) {
-            it(j, 0, ctx->menu[i].size) st[i].menu[j] = ctx->menu[i].data[j];
-        }
+            zshmget(sizeof(worker_t) * wk_slots(&ctx->config));
     }
+
+    /* Every semaphore is allocated: write the initial values at once */
+    sem_pool_commit(&g_sem_pool);
     return st;
 }
 
 /**
- * @brief Cleanup for a specific station.
+ * @brief Creates the IPC objects that only live for one day: the station
+ * queues, the worker seats and the table seats.
+ * * Closing them at the end of the day (close_day_ipc) releases every process
+ * blocked on them with EIDRM, so no signal has to be sent around.
+ */
+void
+open_day_ipc(simctx_t *ctx, station *st) {
+    it(i, 0, NOF_STATIONS) ctx->id_msg_q[i] =
+        zmsgget(IPC_PRIVATE, IPC_CREAT | SHM_RW);
+
+    sem_pool_init(&g_day_pool);
+    ctx->sem[tbl] = sem_init(&g_day_pool, ctx->config.nof_tbl_seats);
+    it(i, 0, NOF_STATIONS) st[i].wk_data.sem =
+        sem_init(&g_day_pool, ctx->config.nof_wk_seats[i]);
+    sem_pool_commit(&g_day_pool);
+}
+
+/**
+ * @brief Removes the day's queues and semaphores, requests still queued are
+ * dropped with them.
+ */
+void
+close_day_ipc(simctx_t *ctx) {
+    it(i, 0, NOF_STATIONS) msg_kill((int)ctx->id_msg_q[i]);
+    sem_pool_kill(&g_day_pool);
+}
+
+/**
+ * @brief Cleanup for a specific station, its workers are stopped by
+ * kill_all_child.
  */
 void
 release_station(station st) {
-    const worker_t *wks = get_workers(st.wk_data.shmid);
-    it(j, 0, st.wk_data.cap) {
-        kill(wks[j].pid, SIGTERM);
-        msg_kill(wks[j].queue);
-    }
-    shmdt(wks);
+    zshmdt(st.wk_data.shmid);
     shm_kill(st.wk_data.shmid);
-    sem_kill(st.wk_data.sem);
-    sem_kill(st.sem);
 }
 
 /**
  * @brief Forks a new worker process.
+ * @param spawn Extra worker started by the autoscaler for the current day,
+ * numbered from 1 over the whole run; 0 for a worker of the roster.
  */
-void
+pid_t
 init_worker(
-    const shmid_t ctx_id,
-    const shmid_t st_id,
-    const size_t  idx,
-    const loc_t   role
+    const shmid_t  ctx_id,
+    const shmid_t  st_id,
+    const size_t   idx,
+    const loc_t    role,
+    const uint32_t spawn
 ) {
     const pid_t pid = zfork();
     if (pid == 0) {
+        join_pgroup(0, &g_pgid.workers);
         char *args[] = {"worker",       itos((int)ctx_id), itos((int)st_id),
-                        itos((int)idx), itos(role),        NULL};
-        execve("./bin/worker", args, NULL);
+                        itos((int)idx), itos(role),        itos((int)spawn),
+                        NULL};
+        execve("./bin/worker", args, environ);
         panic("ERROR: Execve failed launching a worker\n");
     }
+    join_pgroup(pid, &g_pgid.workers);
+    return pid;
+}
+
+/**
+ * @brief Charges a minute of every running elastic worker to the station it
+ * serves now, which a rebalance may have changed since its start.
+ */
+void
+charge_elastic(simctx_t *ctx, station *st) {
+    it(s, 0, NOF_STATIONS) {
+        const worker_t *wks = get_workers(st[s].wk_data.shmid);
+        it(j, (size_t)ctx->config.nof_workers, wk_slots(&ctx->config)) {
+            if (wks[j].pid != 0 && wks[j].elastic)
+                st[s].stats.elastic_time++;
+        }
+    }
+}
+
+/**
+ * @brief Starts an elastic worker at every overloaded station with a free
+ * seat and retires one from every idle station, within the global budget.
+ */
+void
+autoscale(simctx_t *ctx, station *st) {
+    bool grow[NOF_STATIONS], idle[NOF_STATIONS];
+    scale_check(ctx, st, grow, idle);
+
+    it(i, 0, NOF_STATIONS) {
+        if (idle[i]) {
+            retire_elastic(ctx, st, (loc_t)i);
+            continue;
+        }
+        if (!grow[i])
+            continue;
+
+        ssize_t slot = -1;
+        it(k, 0, ctx->config.autoscale_budget) {
+            if (g_elastic.pid[k] == 0) {
+                slot = (ssize_t)k;
+                break;
+            }
+        }
+        if (slot == -1)
+            continue; // budget used up, later stations may still retire
+
+        const size_t idx = ctx->config.nof_workers + slot;
+        g_elastic.pid[slot] =
+            init_worker(g_shmid, g_st_shmid, idx, (loc_t)i, ++g_elastic.spawned);
+        st[i].stats.scale_up++;
+
+        zprintf(
+            ctx->sem[out],
+            "MAIN: Starting elastic worker %d at station %d (queue %zu)\n",
+            g_elastic.pid[slot], i, station_backlog(ctx, &st[i])
+        );
+    }
+}
+
+/**
+ * @brief Collects the elastic workers that exited, freeing their slots.
+ * @param wait_all Wait for every one of them (end of the day), waking those
+ * still blocked on a queue or a seat.
+ */
+void
+reap_elastic(simctx_t *ctx, const bool wait_all) {
+    it(k, 0, ctx->config.autoscale_budget) {
+        if (g_elastic.pid[k] == 0)
+            continue;
+
+        pid_t res;
+        while ((res = waitpid(g_elastic.pid[k], NULL, WNOHANG)) == 0 &&
+               wait_all) {
+            kill(g_elastic.pid[k], SIGUSR1);
+            znsleep(1);
+        }
+        if (res != 0)
+            g_elastic.pid[k] = 0;
+    }
 }
 
 /**
@@ -554,15 +1185,20 @@ init_groups(simctx_t *ctx, const shmid_t ctx_shm) {
             target_size = (rand() % ctx->config.max_users_per_group) + 1;
             if (target_size > users_remaining)
                 target_size = users_remaining;
+            target_size = trace_group_size(ctx, group_idx, target_size);
 
             ctx->groups[group_idx].id            = group_idx;
             ctx->groups[group_idx].total_members = target_size;
             ctx->groups[group_idx].members_ready = 0;
-            ctx->groups[group_idx].sem           = sem_init(0);
+            ctx->groups[group_idx].generation    = 0;
+            ctx->groups[group_idx].pay_price        = 0;
+            ctx->groups[group_idx].pay_ticket_price = 0;
+            ctx->groups[group_idx].pay_items        = 0;
+            ctx->groups[group_idx].pay_tickets      = 0;
             members_current_group                = target_size;
         }
 
-        init_client(ctx_shm, group_idx);
+        init_client(ctx_shm, group_idx, draw_ticket(ctx));
         members_current_group--;
         users_remaining--;
         if (members_current_group == 0)
@@ -570,64 +1206,101 @@ init_groups(simctx_t *ctx, const shmid_t ctx_shm) {
     }
 }
 
+/**
+ * @brief Rebuilds the groups of a checkpoint and forks their clients again,
+ * each in its old group with its old ticket.
+ */
+void
+restore_groups(simctx_t *ctx, const shmid_t ctx_shm) {
+    it(i, 0, g_ckpt.users) {
+        ctx->groups[i]               = (struct groups_t){0};
+        ctx->groups[i].id            = i;
+        ctx->groups[i].total_members = g_ckpt.group_size[i];
+    }
+    it(i, 0, g_ckpt.users) {
+        init_client(ctx_shm, g_ckpt.group[i], g_ckpt.ticket[i]);
+    }
+
+    /* A disorder still running blocks the checkout again at the opening */
+    g_disorder_left = g_ckpt.disorder_left;
+    g_users_left    = g_ckpt.users_left;
+
+    zprintf(
+        ctx->sem[out], "MAIN: Resumed after day %u with %u users\n",
+        g_ckpt.days, g_ckpt.users
+    );
+}
+
+/**
+ * @brief Ticket flag of the next client spawned, 80% have one.
+ */
+bool
+draw_ticket(const simctx_t *ctx) {
+    return trace_ticket(ctx, g_client_pids.cnt, rand() % 100 < 80);
+}
+
 /**
  * @brief Forks a new client process.
  */
 void
-init_client(const shmid_t ctx_id, const size_t group_idx) {
-    const pid_t pid         = zfork();
-    char       *ticket_attr = (rand() % 100 < 80) ? "1" : "0";
+init_client(const shmid_t ctx_id, const size_t group_idx, const bool ticket) {
+    const size_t idx         = g_client_pids.cnt;
+    char        *ticket_attr = ticket ? "1" : "0";
+    const pid_t  pid         = zfork();
 
     if (pid == 0) {
+        join_pgroup(0, &g_pgid.clients);
         char *args[] = {
-            "client", ticket_attr, itos((int)ctx_id), itos((int)group_idx), NULL
+            "client",           ticket_attr, itos((int)ctx_id),
+            itos((int)group_idx), itos((int)idx), NULL
         };
-        execve("./bin/client", args, NULL);
+        execve("./bin/client", args, environ);
         panic("ERROR: Execve failed for client\n");
     }
-    g_client_pids.id[g_client_pids.cnt++] = pid;
+    join_pgroup(pid, &g_pgid.clients);
+    g_client_pids.group[g_client_pids.cnt]  = group_idx;
+    g_client_pids.ticket[g_client_pids.cnt] = ticket;
+    g_client_pids.id[g_client_pids.cnt++]   = pid;
 }
 
 /**
- * @brief Terminates all active client processes.
+ * @brief Puts a freshly forked child in the process group of its kind; the
+ * first child becomes the leader. Both sides of the fork call it, so the
+ * child is in place whichever runs first (pid 0 = the calling child).
  */
 void
-release_clients(simctx_t *ctx) {
-    it(i, 0, ctx->config.nof_users) kill(g_client_pids.id[i], SIGTERM);
+join_pgroup(const pid_t pid, pid_t *pgid) {
+    setpgid(pid, *pgid);
+    if (*pgid == 0)
+        *pgid = pid ? pid : getpid();
 }
 
 /**
  * @brief Sends a specific signal to all child processes (workers and clients).
  */
 void
-kill_all_child(simctx_t *ctx, station *stations, int sig) {
-    it(i, 0, NOF_STATIONS) {
-        const worker_t *wks = get_workers(stations[i].wk_data.shmid);
-        it(j, 0, stations[i].wk_data.cap) { kill(wks[j].pid, sig); }
-    }
-    it(i, 0, ctx->config.nof_users) { kill(g_client_pids.id[i], sig); }
+kill_all_child(int sig) {
+    if (g_pgid.workers > 0)
+        killpg(g_pgid.workers, sig);
+    if (g_pgid.clients > 0)
+        killpg(g_pgid.clients, sig);
 }
 
 /**
- * @brief Exports essential shared memory IDs to disk and sets up signal
- * handlers.
+ * @brief Exports essential shared memory IDs to disk, for the dashboard.
  */
 void
 write_shared_data(shmid_t ctx_shm, shmid_t st_shm) {
-    FILE *f = zfopen("data/shared", "w");
+    FILE *f = zfopen(run_path("shared"), "w");
     fprintf(f, "%d, %d\n", (int)ctx_shm, (int)st_shm);
     fclose(f);
 
-    FILE *f_pid = zfopen("data/main.pid", "w");
+    FILE *f_pid = zfopen(run_path("main.pid"), "w");
     fprintf(f_pid, "%d", getpid());
     fclose(f_pid);
 
-    g_shmid = ctx_shm;
-
-    struct sigaction sa_add;
-    memset(&sa_add, 0, sizeof(sa_add));
-    sa_add.sa_handler = handler_new_users;
-    sigaction(SIGUSR2, &sa_add, NULL);
+    g_shmid    = ctx_shm;
+    g_st_shmid = st_shm;
 }
 
 /**
@@ -635,11 +1308,11 @@ write_shared_data(shmid_t ctx_shm, shmid_t st_shm) {
  */
 void
 reset_shared_data() {
-    FILE *f = zfopen("data/shared", "w");
+    FILE *f = zfopen(run_path("shared"), "w");
     fprintf(f, "%d, %d\n", -1, -1);
     fclose(f);
 
-    FILE *f_pid = zfopen("data/main.pid", "w");
+    FILE *f_pid = zfopen(run_path("main.pid"), "w");
     fprintf(f_pid, "%d", -1);
     fclose(f_pid);
 }
@@ -649,232 +1322,83 @@ reset_shared_data() {
  * ================================================================= */
 
 /**
- * @brief Renders the real-time simulation dashboard.
+ * @brief Publishes the metrics of the current minute for the dashboards.
+ * * This is the only place reading semaphores, queues and station counters
+ * for display, once per tick however many viewers are attached; the
+ * in-process dashboard draws the same copy.
  */
 void
-render_dashboard(
-    screen   *s,
-    simctx_t *ctx,
-    station  *st,
-    size_t    day,
-    size_t    min,
-    int       new_clients
-) {
-    s_clear(s);
-    const size_t W     = s->cols;
-    const size_t H     = s->rows;
-    const size_t mid_x = W / 2;
-
-    static int notification_timer = 0;
-    static int saved_user_count   = 0;
-
-    if (new_clients > 0) {
-        notification_timer = TUI_NOTIFICATIONS_LEN;
-        saved_user_count   = new_clients;
-    }
-
-    draw_box(s, 0, 0, W, H, COL_GRAY);
-    const char *title = " OASI DEL GOLFO - DASHBOARD ";
-    s_draw_text(s, (W - strlen(title)) / 2, 0, COL_WHITE, title);
-
-    draw_hline(s, 1, 2, W - 2, COL_GRAY);
-    s_draw_text(s, 0, 2, COL_GRAY, BOX_VR);
-    s_draw_text(s, W - 1, 2, COL_GRAY, BOX_VL);
-    s_draw_text(s, mid_x, 2, COL_GRAY, BOX_HD);
-
-    /* Header Info */
-    s_draw_text(s, 2, 1, COL_GRAY, "DAY: ");
-    s_draw_text(s, 10, 1, COL_WHITE, "%zu/%d", day, ctx->config.sim_duration);
-
-    int u_total    = ctx->config.nof_users;
-    int u_finished = sem_getval(ctx->sem[cl_end]);
-    int u_inside   = u_total - u_finished;
-
-    if (u_total > 0) {
-        int   bar_w = 20;
-        float pct   = (float)u_inside / (float)u_total;
-        char  count_buf[32];
-        snprintf(count_buf, 32, "%3d/%3d", u_inside, u_total);
-        int count_len = strlen(count_buf);
-
-        int end_x   = W - 2;
-        int count_x = end_x - count_len;
-        int bar_x   = count_x - 1 - bar_w;
-        int label_x = bar_x - 7;
-
-        if (label_x > (int)mid_x) {
-            s_draw_text(s, label_x, 1, COL_GRAY, "Users:");
-            s_draw_bar(s, bar_x, 1, bar_w, pct, COL_WHITE, COL_GRAY);
-            s_draw_text(s, count_x, 1, COL_WHITE, "%s", count_buf);
-        }
-    }
-
-    draw_vline(s, mid_x, 3, H - 4, COL_GRAY);
-    s_draw_text(s, mid_x, H - 1, COL_GRAY, BOX_HU);
+publish_snapshot(simctx_t *ctx, station *st, size_t day, size_t min) {
+    snapshot_t *snap = &g_snap;
+
+    snap->running     = ctx->is_sim_running;
+    snap->disorder    = ctx->is_disorder_active;
+    snap->day         = day;
+    snap->days        = (size_t)ctx->config.sim_duration;
+    snap->min         = min;
+    snap->users_total = (size_t)ctx->config.nof_users;
+    snap->users_in    = __atomic_load_n(&ctx->day.users_in, __ATOMIC_RELAXED);
+    snap->not_served  = ctx->global_stats.users_not_served;
+    snap->seated      = ctx->config.nof_tbl_seats - sem_getval(ctx->sem[tbl]);
 
-    /* Left Column: Flow Statistics */
-    size_t r  = 4;
-    size_t c1 = 2;
-    s_draw_text(s, c1, r++, COL_WHITE, "\u25BA FLOW STATISTICS");
-    r++;
-
-    size_t tot_served = 0;
-    size_t tot_breaks = 0;
     it(i, 0, NOF_STATIONS) {
-        tot_served += st[i].stats.served_dishes;
-        tot_breaks += st[i].stats.total_breaks;
-    }
-    size_t tot_not_srv = ctx->global_stats.users_not_served;
-    size_t u_eating    = ctx->config.nof_tbl_seats - sem_getval(ctx->sem[tbl]);
-
-    int label_w = 18;
-    s_draw_text(s, c1 + 2, r, COL_GRAY, "Total Served:");
-    s_draw_text(s, c1 + 2 + label_w, r++, COL_WHITE, "%zu", tot_served);
-    s_draw_text(s, c1 + 2, r, COL_GRAY, "Not Served:");
-    s_draw_text(s, c1 + 2 + label_w, r++, COL_WHITE, "%zu", tot_not_srv);
-    s_draw_text(s, c1 + 2, r, COL_GRAY, "Seated at Tables:");
-    s_draw_text(s, c1 + 2 + label_w, r++, COL_WHITE, "%d", u_eating);
-
-    r += 2;
-    s_draw_text(s, c1, r++, COL_WHITE, "\u25BA ECONOMY & STAFF");
-    r++;
-
-    size_t revenue = st[CHECKOUT].stats.earnings;
-    s_draw_text(s, c1 + 2, r, COL_GRAY, "Revenue:");
-    s_draw_text(s, c1 + 2 + label_w, r++, COL_WHITE, "%zu€", revenue);
-    s_draw_text(s, c1 + 2, r, COL_GRAY, "Total Breaks:");
-    s_draw_text(s, c1 + 2 + label_w, r++, COL_WHITE, "%zu", tot_breaks);
-
-    /* Right Column: Kitchen & Efficiency */
-    r         = 4;
-    size_t c2 = mid_x + 3;
-    s_draw_text(s, c2, r++, COL_WHITE, "\u25BA KITCHEN STATUS");
-    r++;
-
-    int off_p = 0;
-    int off_s = 14;
-    int off_r = 24;
-    s_draw_text(s, c2 + off_p, r, COL_GRAY, "DISH");
-    s_draw_text(s, c2 + off_s, r, COL_GRAY, "SERVED");
-    s_draw_text(s, c2 + off_r, r, COL_GRAY, "LEFT");
-    r++;
-    draw_hline(s, c2, r++, 32, COL_GRAY);
-
-    const char *labels[] = {"First", "Main", "Coffee"};
-    const int   types[]  = {FIRST_COURSE, MAIN_COURSE, COFFEE_BAR};
-
-    it(i, 0, 3) {
-        int t = types[i];
-        s_draw_text(s, c2 + off_p, r, COL_WHITE, "%s", labels[i]);
-        s_draw_text(
-            s, c2 + off_s, r, COL_WHITE, "%zu", st[t].stats.served_dishes
-        );
-        if (t == COFFEE_BAR) {
-            s_draw_text(s, c2 + off_r, r, COL_WHITE, "\u221E");
-        } else {
-            size_t leftovers = 0;
-            it(k, 0, ctx->avl_dishes[t].size) leftovers +=
-                ctx->avl_dishes[t].data[k].quantity;
-            uint8_t col = (leftovers < 10) ? COL_WHITE : COL_GRAY;
-            s_draw_text(s, c2 + off_r, r, col, "%zu", leftovers);
-        }
-        r++;
-    }
-
-    r += 2;
-    s_draw_text(s, c2, r++, COL_WHITE, "\u25BA STATION EFFICIENCY");
-    r++;
+        snap->st[i].served      = st[i].stats.served_dishes;
+        snap->st[i].breaks      = st[i].stats.total_breaks;
+        snap->st[i].worked_time = st[i].stats.worked_time;
+        snap->st[i].earnings    = st[i].stats.earnings;
+        snap->st[i].queued      = station_backlog(ctx, &st[i]);
+        snap->st[i].cap         = st[i].wk_data.cap;
+        snap->st[i].active      = station_active(ctx, &st[i]);
+        snap->st[i].leftovers =
+            i < COFFEE_BAR ? menu_leftovers(g_menu, (dish_type)i) : 0;
 
-    const char *st_names[] = {"First", "Main", "Coffee", "Check"};
-    it(i, 0, NOF_STATIONS) {
-        float avg =
-            st[i].stats.served_dishes > 0
-                ? (float)st[i].stats.worked_time / st[i].stats.served_dishes
-                : 0.0f;
-        int cap = (int)st[i].wk_data.cap;
-        int active =
-            ctx->config.nof_wk_seats[i] - sem_getval(st[i].wk_data.sem);
         const worker_t *wks = get_workers(st[i].wk_data.shmid);
-
-        s_draw_text(s, c2, r, COL_GRAY, "%s:", st_names[i]);
-        s_draw_text(s, c2 + 7, r, COL_WHITE, "%4.0fns", avg);
-        s_draw_text(s, c2 + 17, r, COL_WHITE, "%02d/%02d", active, cap);
-
-        int bar_x = c2 + 22;
-        s_draw_text(s, bar_x, r, COL_GRAY, "[");
-        for (int k = 0; k < cap; k++) {
-            if (wks[k].paused)
-                s_draw_text(s, bar_x + 1 + k, r, COL_GRAY, "_");
-            else
-                s_draw_text(s, bar_x + 1 + k, r, COL_WHITE, "\u25A0");
+        snap->st[i].workers = 0;
+        snap->st[i].paused  = 0;
+        it(j, 0, wk_slots(&ctx->config)) {
+            if (wks[j].pid == 0)
+                continue;
+            snap->st[i].workers++;
+            if (wks[j].paused)
+                snap->st[i].paused++;
         }
-        s_draw_text(s, bar_x + 1 + cap, r, COL_GRAY, "]");
-        r++;
     }
 
-    /* Footer & System Alerts */
-    int footer_y = s->rows - 4;
-    if (notification_timer > 0) {
-        s_draw_text(
-            s, 2, footer_y, COL_GREEN, "!!! %d NEW CLIENTS ARRIVED !!!",
-            saved_user_count
-        );
-        notification_timer--;
-    }
-    s_draw_text(s, 2, H - 2, COL_GRAY, "Press [q] to terminate simulation.");
-
-    /* Disorder / Glitch UI Effect */
-    int box_x = mid_x + 2;
-    int box_y = H - 2;
-    s_draw_text(s, box_x, box_y, COL_GRAY, "SYS:[");
-    if (ctx->is_disorder_active) {
-        const char *glitch_chars[] = {"▂", "▃", "▄"};
-        for (int i = 0; i < 15; i++) {
-            if ((min + i) % 7 == 0 && i % 3 == 0)
-                s_draw_text(
-                    s, box_x + 5 + i, box_y, COL_RED, "%s", glitch_chars[i % 3]
-                );
-            else
-                s_draw_text(s, box_x + 5 + i, box_y, COL_RED, "▁");
-        }
-        int blink_state = (min / 2) % 4;
-        if (blink_state == 0 || blink_state == 2)
-            s_draw_text(s, box_x + 24, box_y, COL_RED, "!ALERT!");
-    } else {
-        const char *pattern[] = {"▂", "▂", "▃", "▃", "▄", "▄", "▅", "▅",
-                                 "▆", "▆", "▇", "▇", "▇", "▆", "▆", "▅",
-                                 "▅", "▄", "▄", "▃", "▃", "▂", "▂"};
-        for (int i = 0; i < 16; i++) {
-            int idx = ((min * 2) + i) % 23;
-            s_draw_text(s, box_x + 5 + i, box_y, COL_GREEN, "%s", pattern[idx]);
-        }
-    }
-    s_draw_text(s, box_x + 21, box_y, COL_GRAY, "]");
+    snap_publish(ctx, snap);
+}
 
-    s_draw_text(s, W - 1, 0, COL_GRAY, BOX_TR);
-    s_draw_text(s, W - 1, H - 1, COL_GRAY, BOX_BR);
-    s_display(s);
+/**
+ * @brief Tells why the simulation ended, from the state left by the last day.
+ * * Overload is judged on the users counted when the day ended, children
+ * killed afterwards still leave the day and empty ctx->day.users_in.
+ * @param ctx Global context.
+ * @param manual_quit Whether the run was stopped by the user or a signal.
+ * @return The outcome, also used as exit code.
+ */
+run_outcome_t
+run_outcome(const simctx_t *ctx, bool manual_quit) {
+    if (manual_quit)
+        return RUN_INTERRUPTED;
+    if (g_disorder_left > 0)
+        return RUN_DISORDER;
+    if (g_users_left >= ctx->config.overload_threshold)
+        return RUN_OVERLOAD;
+    return RUN_COMPLETED;
 }
 
 /**
  * @brief Displays a summary report after the simulation ends.
  */
 void
-render_final_report(screen *s, simctx_t *ctx, station *st, bool manual_quit) {
-    const int users_finished = sem_getval(ctx->sem[cl_end]);
+render_final_report(
+    screen *s, simctx_t *ctx, station *st, run_outcome_t outcome, size_t days
+) {
+    const int users_finished = g_users_left;
     const int limit_users    = ctx->config.overload_threshold;
 
-    const bool is_disorder = ctx->is_disorder_active;
-    const bool is_overload = !manual_quit && (users_finished >= limit_users);
-    const bool is_timeout  = !manual_quit && !is_overload && !is_disorder;
-
     /* Snapshot current leftovers */
-    size_t left_primi = 0;
-    it(k, 0, ctx->avl_dishes[FIRST_COURSE].size) left_primi +=
-        ctx->avl_dishes[FIRST_COURSE].data[k].quantity;
-    size_t left_secondi = 0;
-    it(k, 0, ctx->avl_dishes[MAIN_COURSE].size) left_secondi +=
-        ctx->avl_dishes[MAIN_COURSE].data[k].quantity;
+    const size_t left_primi   = menu_leftovers(g_menu, FIRST);
+    const size_t left_secondi = menu_leftovers(g_menu, MAIN);
 
     const size_t tot_primi    = st[FIRST_COURSE].total_stats.served_dishes;
     const size_t tot_secondi  = st[MAIN_COURSE].total_stats.served_dishes;
@@ -884,24 +1408,29 @@ render_final_report(screen *s, simctx_t *ctx, station *st, bool manual_quit) {
     const size_t tot_breaks   = ctx->global_stats.total_breaks;
     const size_t tot_unserved = ctx->global_stats.users_not_served;
 
+    model_t model;
+    size_t  menu_size[MENU_CATEGORIES];
+    it(t, 0, MENU_CATEGORIES) menu_size[t] = g_menu->cat[t].size;
+    model_estimate(&ctx->config, menu_size, &model);
+
     int         status_col;
     const char *title_status;
     char        reason[128];
 
-    if (manual_quit) {
+    if (outcome == RUN_INTERRUPTED) {
         status_col   = COL_GRAY;
         title_status = "SIMULATION INTERRUPTED";
         snprintf(
             reason, sizeof(reason), "REASON: Manual Interruption (Q / CTRL+C)"
         );
-    } else if (is_disorder) {
+    } else if (outcome == RUN_DISORDER) {
         status_col   = COL_RED;
         title_status = "TERMINATION: COM. DISORDER";
         snprintf(
             reason, sizeof(reason),
             "REASON: Checkout station blocked (Communication Disorder)"
         );
-    } else if (is_overload) {
+    } else if (outcome == RUN_OVERLOAD) {
         status_col   = COL_RED;
         title_status = "TERMINATION: OVERLOAD";
         snprintf(
@@ -940,6 +1469,11 @@ render_final_report(screen *s, simctx_t *ctx, station *st, bool manual_quit) {
         s_draw_text(s, val_x, r++, COL_GREEN, "%zu €", tot_earn);
         s_draw_text(s, c1, r, COL_GRAY, "Total Staff Breaks:");
         s_draw_text(s, val_x, r++, COL_WHITE, "%zu", tot_breaks);
+        s_draw_text(s, c1, r, COL_GRAY, "Queue Wait p95:");
+        s_draw_text(
+            s, val_x, r++, COL_WHITE, "%zu min",
+            class_percentile(ctx->global_stats.wait_hist, REQ_CLASSES, 0.95)
+        );
         r++;
         s_draw_text(s, c1, r, COL_GRAY, "Total Unserved Users:");
         s_draw_text(
@@ -970,6 +1504,37 @@ render_final_report(screen *s, simctx_t *ctx, station *st, bool manual_quit) {
             s, c2, r, COL_WHITE, "Coffee        %zu          \u221E", tot_caffe
         );
 
+        /* Queueing model next to what the simulation measured */
+        const char *names[] = {"First", "Main", "Coffee", "Checkout"};
+        r                   = 19;
+        if (r + NOF_STATIONS + 3 < H - 4) {
+            s_draw_text(s, c1, r++, COL_WHITE, "\u25BA MODEL vs SIMULATION");
+            draw_hline(s, c1, r++, W - c1 - 4, COL_GRAY);
+            s_draw_text(
+                s, c1, r++, COL_GRAY,
+                "STATION     SERVERS   UTIL MODEL/SIM    WAIT MODEL/SIM (min)"
+            );
+            it(i, 0, NOF_STATIONS) {
+                const model_station_t *m = &model.st[i];
+                const double util = sim_utilization(&st[i], m->servers, days);
+                const double wait = class_mean(st[i].total_stats.wait_hist);
+
+                if (m->stable)
+                    s_draw_text(
+                        s, c1, r++, COL_WHITE,
+                        "%-10s  %-8zu  %3.0f%% / %3.0f%%       %6.1f / %.1f",
+                        names[i], m->servers, m->rho * 100, util * 100, m->wq,
+                        wait
+                    );
+                else
+                    s_draw_text(
+                        s, c1, r++, COL_RED,
+                        "%-10s  %-8zu  %3.0f%% / %3.0f%%     overload / %.1f",
+                        names[i], m->servers, m->rho * 100, util * 100, wait
+                    );
+            }
+        }
+
         int footer_y = H - 4;
         draw_hline(s, 1, footer_y, W - 2, COL_GRAY);
         s_draw_text(
@@ -985,6 +1550,157 @@ render_final_report(screen *s, simctx_t *ctx, station *st, bool manual_quit) {
     }
 }
 
+/**
+ * @brief Prints the end of run summary as JSON, in place of the final report
+ * when running headless.
+ * * Totals cover every simulated day; the per station counters come from
+ * total_stats, leftovers are the portions left at the end.
+ * @param f Destination stream.
+ * @param ctx Global context.
+ * @param st Stations array.
+ * @param outcome Why the run ended, also the exit code.
+ * @param days Days actually simulated.
+ * @param wall_ms Real time spent in the simulation loop.
+ */
+void
+write_summary(
+    FILE         *f,
+    simctx_t     *ctx,
+    station      *st,
+    run_outcome_t outcome,
+    size_t        days,
+    long          wall_ms
+) {
+    const char *name       = outcome == RUN_OVERLOAD      ? "overload"
+                             : outcome == RUN_DISORDER    ? "disorder"
+                             : outcome == RUN_INTERRUPTED ? "interrupted"
+                                                          : "completed";
+    stats      *g          = &ctx->global_stats;
+
+    model_t model;
+    size_t  menu_size[MENU_CATEGORIES];
+    it(t, 0, MENU_CATEGORIES) menu_size[t] = g_menu->cat[t].size;
+    model_estimate(&ctx->config, menu_size, &model);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "outcome", name);
+    cJSON_AddNumberToObject(root, "exit_code", outcome);
+    cJSON_AddNumberToObject(root, "days", days);
+    cJSON_AddNumberToObject(root, "sim_duration", ctx->config.sim_duration);
+    cJSON_AddNumberToObject(root, "users", ctx->config.nof_users);
+    cJSON_AddNumberToObject(root, "workers", ctx->config.nof_workers);
+    cJSON_AddNumberToObject(root, "wall_ms", wall_ms);
+    cJSON_AddNumberToObject(root, "seed", ctx->seed);
+
+    cJSON_AddNumberToObject(root, "served_dishes", g->served_dishes);
+    cJSON_AddNumberToObject(root, "users_not_served", g->users_not_served);
+    cJSON_AddNumberToObject(root, "earnings", g->earnings);
+    cJSON_AddNumberToObject(root, "payments", g->payments);
+    cJSON_AddNumberToObject(root, "total_breaks", g->total_breaks);
+    cJSON_AddNumberToObject(root, "forced_breaks", g->forced_breaks);
+    cJSON_AddNumberToObject(root, "transfers", g->transfers);
+    cJSON_AddNumberToObject(root, "stolen", g->stolen);
+    cJSON_AddNumberToObject(root, "scale_up", g->scale_up);
+    cJSON_AddNumberToObject(root, "scale_down", g->scale_down);
+    cJSON_AddNumberToObject(root, "elastic_minutes", g->elastic_time);
+    cJSON_AddNumberToObject(
+        root, "wait_p95", class_percentile(g->wait_hist, REQ_CLASSES, 0.95)
+    );
+
+    cJSON *stations = cJSON_AddObjectToObject(root, "stations");
+    it(i, 0, NOF_STATIONS) {
+        stats *t    = &st[i].total_stats;
+        cJSON *item = cJSON_AddObjectToObject(stations, g_station_keys[i]);
+
+        cJSON_AddNumberToObject(item, "served", t->served_dishes);
+        cJSON_AddNumberToObject(item, "earnings", t->earnings);
+        cJSON_AddNumberToObject(item, "breaks", t->total_breaks);
+        cJSON_AddNumberToObject(item, "transfers", t->transfers);
+        cJSON_AddNumberToObject(item, "stolen", t->stolen);
+        cJSON_AddNumberToObject(item, "queue_peak", t->queue_peak);
+        cJSON_AddNumberToObject(
+            item, "wait_p95", class_percentile(t->wait_hist, REQ_CLASSES, 0.95)
+        );
+        if (i < COFFEE_BAR)
+            cJSON_AddNumberToObject(
+                item, "leftovers", menu_leftovers(g_menu, (dish_type)i)
+            );
+
+        /* Measured against the queueing model of the same config */
+        cJSON_AddNumberToObject(
+            item, "utilization",
+            sim_utilization(&st[i], model.st[i].servers, days)
+        );
+        cJSON_AddNumberToObject(item, "wait_mean", class_mean(t->wait_hist));
+        add_model(cJSON_AddObjectToObject(item, "model"), &model.st[i]);
+    }
+
+    char *out = cJSON_Print(root);
+    fprintf(f, "%s\n", out);
+    fflush(f);
+    free(out);
+    cJSON_Delete(root);
+}
+
+/**
+ * @brief Fraction of the serving capacity of a station spent serving, over
+ * the simulated days.
+ */
+double
+sim_utilization(const station *st, size_t servers, size_t days) {
+    const double capacity = (double)servers * WORK_DAY_MINUTES * days;
+    return capacity > 0 ? (double)st->total_stats.worked_time / capacity : 0;
+}
+
+/**
+ * @brief Adds the queueing model figures of one station to a JSON object.
+ * * An overloaded station has no steady state: queue and wait are null.
+ */
+void
+add_model(cJSON *item, const model_station_t *m) {
+    cJSON_AddNumberToObject(item, "arrivals_per_min", m->lambda);
+    cJSON_AddNumberToObject(item, "service", m->srvc);
+    cJSON_AddNumberToObject(item, "servers", m->servers);
+    cJSON_AddNumberToObject(item, "utilization", m->rho);
+    cJSON_AddBoolToObject(item, "stable", m->stable);
+    if (m->stable) {
+        cJSON_AddNumberToObject(item, "queue", m->lq);
+        cJSON_AddNumberToObject(item, "wait", m->wq);
+        cJSON_AddNumberToObject(
+            item, "wait_p95", model_wait_quantile(m, 0.95)
+        );
+    } else {
+        cJSON_AddNullToObject(item, "queue");
+        cJSON_AddNullToObject(item, "wait");
+        cJSON_AddNullToObject(item, "wait_p95");
+    }
+}
+
+/**
+ * @brief Prints the queueing model estimate of a config as JSON, for
+ * --estimate.
+ */
+void
+write_estimate(FILE *f, const conf_t *conf, const model_t *model) {
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddBoolToObject(root, "stable", model->stable);
+    cJSON_AddNumberToObject(root, "users", model->users);
+    cJSON_AddNumberToObject(root, "arrival_window", model->window);
+    cJSON_AddNumberToObject(root, "unserved", model->unserved);
+    cJSON_AddNumberToObject(root, "workers", conf->nof_workers);
+
+    cJSON *stations = cJSON_AddObjectToObject(root, "stations");
+    it(i, 0, NOF_STATIONS) add_model(
+        cJSON_AddObjectToObject(stations, g_station_keys[i]), &model->st[i]
+    );
+
+    char *out = cJSON_Print(root);
+    fprintf(f, "%s\n", out);
+    fflush(f);
+    free(out);
+    cJSON_Delete(root);
+}
+
 /**
  * @brief TUI lifecycle: Initialization.
  */
@@ -1010,12 +1726,6 @@ kill_scr(screen *s) {
  * Signal Handlers Implementation
  * ================================================================= */
 
-void
-handler_new_users(int sig) {
-    (void)sig;
-    g_users_req = 1;
-}
-
 void
 handler_stop(int sig) {
     (void)sig;
@@ -8,10 +8,12 @@
 #include <stdio.h>
 
 
+#define MENU_FILE "data/menu.json"
+
 static const char* dish_names[] = {
-    "main",
-    "first",
-    "coffee"
+    [FIRST]  = "first",
+    [MAIN]   = "main",
+    [COFFEE] = "coffee"
 };
 
 static char*
@@ -29,61 +31,152 @@ read_file(const char* filename) {
     return buffer;
 }
 
+/**
+ * First pass over a category: counts the dishes and finds the largest id, so
+ * the shared table can be sized before copying anything.
+ */
 static void
-load_category(
+measure_category(
     const cJSON    *json,
     const dish_type type,
-          dish_t   *target_array,
-          size_t   *size_array,
-    const size_t    max_dishes
+          size_t   *count,
+          size_t   *nof_id
 ) {
-    cJSON *array = cJSON_GetObjectItemCaseSensitive(json, dish_names[type]);
+    *count  = 0;
+    *nof_id = 0;
+
+    const cJSON *array = cJSON_GetObjectItemCaseSensitive(json, dish_names[type]);
     if (!array) return;
 
-    size_t count = (size_t)cJSON_GetArraySize(array);
-    if (count > max_dishes) count = max_dishes;
+    const cJSON *item;
+    cJSON_ArrayForEach(item, array) {
+        const cJSON *id = cJSON_GetObjectItem(item, "id");
+        if (!cJSON_IsNumber(id) || id->valueint < 0 || id->valueint > MAX_DISH_ID)
+            panic("ERROR: Invalid dish id in category \"%s\"\n", dish_names[type]);
 
-    *size_array = count;
+        if ((size_t)id->valueint + 1 > *nof_id)
+            *nof_id = (size_t)id->valueint + 1;
+        (*count)++;
+    }
+}
+
+static void
+load_category(
+    const cJSON    *json,
+    const dish_type type,
+          menu_t   *menu
+) {
+    const cJSON *array = cJSON_GetObjectItemCaseSensitive(json, dish_names[type]);
+    if (!array) return;
 
-    for (size_t i = 0; i < count; i++) {
-        const cJSON *item   = cJSON_GetArrayItem(array, (int)i);
+    ssize_t *index = (ssize_t *)&menu->slots[menu->nof_slots] + menu->cat[type].index;
+    size_t   i     = 0;
 
+    const cJSON *item;
+    cJSON_ArrayForEach(item, array) {
         const cJSON *id    = cJSON_GetObjectItem(item, "id");
         const cJSON *name  = cJSON_GetObjectItem(item, "name");
         const cJSON *price = cJSON_GetObjectItem(item, "price");
         const cJSON *time  = cJSON_GetObjectItem(item, "time");
 
-        if (id && name && price && time) {
-            target_array[i].id          = (size_t)id->valueint;
-            target_array[i].price       = (size_t)price->valueint;
-            target_array[i].eating_time = (size_t)time->valueint;
+        if (!(name && price && time))
+            continue;
 
-            strncpy(target_array[i].name, name->valuestring, DISH_NAME_MAX_LEN - 1);
-            target_array[i].name[DISH_NAME_MAX_LEN - 1] = '\0';
-        }
+        if (index[id->valueint] != -1)
+            panic("ERROR: Duplicated dish id %d in category \"%s\"\n",
+                  id->valueint, dish_names[type]);
+
+        dish_t *dish      = &menu_slot(menu, type, i)->info;
+        dish->id          = (size_t)id->valueint;
+        dish->price       = (size_t)price->valueint;
+        dish->eating_time = (size_t)time->valueint;
+
+        strncpy(dish->name, name->valuestring, DISH_NAME_MAX_LEN - 1);
+        dish->name[DISH_NAME_MAX_LEN - 1] = '\0';
+
+        index[id->valueint] = (ssize_t)(menu->cat[type].first + i);
+        i++;
     }
+
+    menu->cat[type].size = i;
 }
 
-static void
-load_menu(
-    const char *filename,
-    simctx_t   *ctx
-) {
+/**
+ * Loads menu.json into a new shared segment holding the dish catalog and its
+ * id index. Quantities are left to zero, the caller fills the stock.
+ * @return The id of the segment.
+ */
+static shmid_t
+load_menu(const char *filename) {
     char* raw_json = read_file(filename);
 
     cJSON* json = cJSON_Parse(raw_json);
     if (!json) {
         free(raw_json);
-        free(json);
         panic("ERROR: Failed to parse JSON");
     }
 
-    load_category(json, MAIN, ctx->menu[MAIN].data, &ctx->menu[MAIN].size, MAX_ELEMENTS);
-    load_category(json, FIRST, ctx->menu[FIRST].data, &ctx->menu[FIRST].size, MAX_ELEMENTS);
-    load_category(json, COFFEE, ctx->menu[COFFEE].data, &ctx->menu[COFFEE].size, MAX_ELEMENTS);
+    size_t count[MENU_CATEGORIES], nof_id[MENU_CATEGORIES];
+    size_t nof_slots = 0, index_len = 0;
+    it(t, 0, MENU_CATEGORIES) {
+        measure_category(json, (dish_type)t, &count[t], &nof_id[t]);
+        nof_slots += count[t];
+        index_len += nof_id[t];
+    }
+
+    const shmid_t shmid = zshmget(
+        sizeof(menu_t) + nof_slots * sizeof(dish_slot_t) + index_len * sizeof(ssize_t)
+    );
+    menu_t *menu = get_menu(shmid);
+    memset(menu, 0, sizeof(menu_t) + nof_slots * sizeof(dish_slot_t));
+
+    menu->nof_slots = nof_slots;
+    menu->index_len = index_len;
+
+    ssize_t *index = (ssize_t *)&menu->slots[nof_slots];
+    it(i, 0, index_len) index[i] = -1;
+
+    size_t first = 0, idx = 0;
+    it(t, 0, MENU_CATEGORIES) {
+        menu->cat[t].first  = first;
+        menu->cat[t].index  = idx;
+        menu->cat[t].nof_id = nof_id[t];
+        first += count[t];
+        idx   += nof_id[t];
+
+        load_category(json, (dish_type)t, menu);
+    }
 
     cJSON_Delete(json);
     free(raw_json);
+    return shmid;
+}
+
+/**
+ * Dishes of every category of a menu file, counted as load_menu keeps them,
+ * without creating the shared catalog.
+ */
+static void
+menu_sizes(const char *filename, size_t size[MENU_CATEGORIES]) {
+    char  *raw_json = read_file(filename);
+    cJSON *json     = cJSON_Parse(raw_json);
+    free(raw_json);
+    if (!json)
+        panic("ERROR: Failed to parse JSON");
+
+    it(t, 0, MENU_CATEGORIES) {
+        const cJSON *array = cJSON_GetObjectItemCaseSensitive(json, dish_names[t]);
+        const cJSON *item;
+
+        size[t] = 0;
+        cJSON_ArrayForEach(item, array) {
+            if (cJSON_GetObjectItem(item, "name") &&
+                cJSON_GetObjectItem(item, "price") &&
+                cJSON_GetObjectItem(item, "time"))
+                size[t]++;
+        }
+    }
+    cJSON_Delete(json);
 }
 
 
@@ -0,0 +1,293 @@
+#ifndef _MODEL_H
+#define _MODEL_H
+
+#include <math.h>
+
+#include "arrivals.h"
+#include "const.h"
+#include "objects.h"
+#include "tools.h"
+
+/* =========================================================================
+ * Queueing model
+ * An instant estimate of what a config does to the stations, to screen
+ * configs before simulating them. Each station is an M/G/c queue:
+ *   - Poisson arrivals at the mean rate of the day: the users of a day over
+ *     the working day, or over the arrival window of an ARRIVAL_RATE or
+ *     ARRIVAL_PROFILE, times the share of users visiting the station (from
+ *     the menu sizes, the way pick_dishes draws);
+ *   - c servers, the workers worker_split gives the station but at most its
+ *     seats; breaks slow them down unless spare workers cover the seats;
+ *   - service uniform within var_srvc percent of avg_srvc, the checkout one
+ *     scaled with CHECKOUT_BY_ITEMS by the dishes on the tray, or on the
+ *     bill with GROUP_CHECKOUT.
+ * The wait in queue is Erlang C corrected for the service variability
+ * (Allen-Cunneen), its tail exponential as in M/M/c. An overloaded station
+ * still serves what its workers manage in the day: the rest of the demand
+ * are users left unserved. Rushes are not modelled: when every group enters
+ * at the opening the real queues are longer than the estimate.
+ * ========================================================================= */
+
+typedef struct {
+    double lambda;  // richieste al minuto
+    double srvc;    // tempo medio di servizio (minuti), pause comprese
+    double cs2;     // variabilita' del servizio, varianza / media^2
+    size_t servers; // worker che servono insieme, al massimo i posti
+    double rho;     // utilizzo dei server
+    double pw;      // probabilita' di attendere (Erlang C)
+    double served;  // frazione della domanda del giorno smaltita
+    double lq;      // richieste in coda, in media
+    double wq;      // attesa media in coda (minuti)
+    bool   stable;  // rho < 1, altrimenti la coda cresce per tutto il giorno
+} model_station_t;
+
+typedef struct {
+    model_station_t st[NOF_STATIONS];
+    double          users;    // utenti attesi in un giorno
+    double          window;   // minuti su cui arrivano
+    double          unserved; // utenti attesi non serviti in un giorno
+    bool            stable;   // tutte le stazioni stabili
+} model_t;
+
+/**
+ * @brief Splits the roster among the stations: the NOF_WORKERS_* of the
+ * config when given, otherwise one worker each, the rest in proportion to
+ * the service times, the remainder to the slowest stations.
+ * @param cap Output, workers of every station.
+ */
+static inline void
+worker_split(const conf_t *conf, size_t cap[NOF_STATIONS]) {
+    if (conf->nof_wk_roles[0] > 0) {
+        it(i, 0, NOF_STATIONS) cap[i] = (size_t)conf->nof_wk_roles[i];
+        return;
+    }
+
+    int priority[NOF_STATIONS] = {
+        FIRST_COURSE, MAIN_COURSE, COFFEE_BAR, CHECKOUT
+    };
+
+    /* Sort stations by service time to establish allocation priority */
+    it(i, 0, NOF_STATIONS - 1) {
+        it(j, 0, NOF_STATIONS - i - 1) {
+            const size_t time_a = conf->avg_srvc[priority[j]];
+            const size_t time_b = conf->avg_srvc[priority[j + 1]];
+            if (time_a < time_b) {
+                const int temp  = priority[j];
+                priority[j]     = priority[j + 1];
+                priority[j + 1] = temp;
+            }
+        }
+    }
+
+    /* Ensure baseline coverage: 1 worker per station */
+    it(i, 0, NOF_STATIONS) cap[i] = 1;
+
+    const int remaining = conf->nof_workers - NOF_STATIONS;
+    if (remaining <= 0)
+        return;
+
+    size_t total_srvc_time = 0;
+    it(i, 0, NOF_STATIONS) { total_srvc_time += conf->avg_srvc[i]; }
+
+    if (total_srvc_time == 0)
+        total_srvc_time = 1;
+    int assigned_count = 0;
+
+    /* Proportional distribution */
+    it(type, 0, NOF_STATIONS) {
+        size_t weight        = conf->avg_srvc[type];
+        int    extra_workers = (int)((weight * remaining) / total_srvc_time);
+        cap[type] += extra_workers;
+        assigned_count += extra_workers;
+    }
+
+    /* Assign remaining workers based on priority list */
+    int leftovers = remaining - assigned_count;
+    int p_idx     = 0;
+
+    while (leftovers > 0) {
+        cap[priority[p_idx]]++;
+        leftovers--;
+        p_idx = (p_idx + 1) % NOF_STATIONS;
+    }
+}
+
+/**
+ * @brief Station of roster worker idx: the roster is numbered station by
+ * station in the order of the split, the way the coordinator spawns it.
+ */
+static inline loc_t
+roster_role(const conf_t *conf, const size_t idx) {
+    size_t cap[NOF_STATIONS], last = 0;
+    worker_split(conf, cap);
+    it(i, 0, NOF_STATIONS) {
+        last += cap[i];
+        if (idx < last)
+            return (loc_t)i;
+    }
+    return CHECKOUT;
+}
+
+/**
+ * @brief Probability that c busy servers make an arrival wait (Erlang C).
+ * * Through the Erlang B recursion, which stays finite for any c.
+ * @param a Offered load, arrivals per service time.
+ */
+static inline double
+erlang_c(const size_t c, const double a) {
+    double b = 1.0;
+    it(k, 1, c + 1) b = a * b / (k + a * b);
+
+    const double rho = a / (double)c;
+    return b / (1.0 - rho * (1.0 - b));
+}
+
+/**
+ * @brief Users of a day and the minutes they arrive over.
+ * * With an arrival profile the rate is summed minute by minute, until every
+ * user came or the day is over.
+ */
+static inline void
+model_arrivals(const conf_t *conf, double *users, double *window) {
+    *users  = conf->nof_users;
+    *window = WORK_DAY_MINUTES;
+    if (!arrivals_open_loop(conf))
+        return;
+
+    double came = 0;
+    int    from = -1, to = WORK_DAY_MINUTES;
+    it(min, 0, WORK_DAY_MINUTES) {
+        const double rate = arrival_rate(conf, (double)min);
+        if (rate > 0 && from == -1)
+            from = min;
+        came += rate;
+        if (came >= conf->nof_users) {
+            to = min + 1;
+            break;
+        }
+    }
+
+    *users  = came < conf->nof_users ? came : conf->nof_users;
+    *window = from == -1 ? WORK_DAY_MINUTES : to - from;
+}
+
+/**
+ * @brief Estimates the load of every station for a config.
+ * @param menu_size Dishes of every menu category.
+ * @param m Output.
+ */
+static inline void
+model_estimate(
+    const conf_t *conf, const size_t menu_size[MENU_CATEGORIES], model_t *m
+) {
+    memset(m, 0, sizeof(*m));
+    model_arrivals(conf, &m->users, &m->window);
+
+    /* pick_dishes skips a course with probability 1 / (size + 1) and draws
+     * again when both first and main are skipped */
+    const double skip_first = 1.0 / (double)(menu_size[FIRST] + 1);
+    const double skip_main  = 1.0 / (double)(menu_size[MAIN] + 1);
+    const double redraw     = skip_first * skip_main;
+    double       visits[NOF_STATIONS];
+
+    visits[FIRST_COURSE] = redraw < 1 ? (1 - skip_first) / (1 - redraw) : 0;
+    visits[MAIN_COURSE]  = redraw < 1 ? (1 - skip_main) / (1 - redraw) : 0;
+    visits[COFFEE_BAR]   = 1.0 - 1.0 / (double)(menu_size[COFFEE] + 1);
+    visits[CHECKOUT]     = 1;
+
+    /* One bill per user, or per group carrying all of its dishes */
+    const double items =
+        visits[FIRST_COURSE] + visits[MAIN_COURSE] + visits[COFFEE_BAR];
+    const double group = (conf->max_users_per_group + 1) / 2.0;
+    const double bill  = conf->group_checkout ? items * group : items;
+    if (conf->group_checkout)
+        visits[CHECKOUT] = 1 / group;
+
+    /* Minutes of break of a worker against the working day */
+    const double off =
+        (double)conf->nof_pause * conf->pause_duration / WORK_DAY_MINUTES;
+    const double on = off < 1 ? 1 - off : 0;
+
+    size_t cap[NOF_STATIONS];
+    worker_split(conf, cap);
+
+    m->stable = true;
+    it(i, 0, NOF_STATIONS) {
+        model_station_t *s   = &m->st[i];
+        double           avg = conf->avg_srvc[i];
+
+        if (i == CHECKOUT && conf->checkout_by_items)
+            avg = avg * bill / MAX_DISHES;
+
+        /* Uniform over the integers within avg +- delta */
+        const double delta = avg * (double)var_srvc[i] / 100;
+        s->cs2 = avg > 0 ? delta * (delta + 1) / 3 / (avg * avg) : 0;
+
+        s->servers = cap[i] < (size_t)conf->nof_wk_seats[i]
+                         ? cap[i]
+                         : (size_t)conf->nof_wk_seats[i];
+        s->lambda  = m->users * visits[i] / m->window;
+
+        /* Breaks cost capacity only when the spare workers can't take over */
+        const double working = (double)cap[i] * on;
+        const double speed =
+            working < (double)s->servers ? working / (double)s->servers : 1;
+        s->srvc = speed > 0 ? avg / speed : INFINITY;
+
+        const double a = s->lambda * s->srvc;
+        s->rho         = s->servers > 0 ? a / (double)s->servers : INFINITY;
+        s->stable      = s->rho < 1;
+        s->served      = s->rho > 1 ? 1 / s->rho : 1;
+
+        /* A user left unserved at any station is unserved */
+        if (m->users * (1 - s->served) > m->unserved)
+            m->unserved = m->users * (1 - s->served);
+
+        if (!s->stable) {
+            s->pw     = 1;
+            s->lq     = INFINITY;
+            s->wq     = INFINITY;
+            m->stable = false;
+            continue;
+        }
+
+        s->pw = s->lambda > 0 ? erlang_c(s->servers, a) : 0;
+        s->wq = s->lambda > 0 ? s->pw /
+                                    ((double)s->servers / s->srvc - s->lambda) *
+                                    (1 + s->cs2) / 2
+                              : 0;
+        s->lq = s->lambda * s->wq;
+    }
+}
+
+/**
+ * @brief Wait in queue that a fraction p of the requests of a station does
+ * not exceed.
+ * * P(wait > t) = pw * exp(-t / (wq / pw)): the mean wait of those who wait
+ * is wq / pw.
+ */
+static inline double
+model_wait_quantile(const model_station_t *s, const double p) {
+    if (!s->stable)
+        return INFINITY;
+    if (s->pw <= 1 - p)
+        return 0;
+    return s->wq / s->pw * log(s->pw / (1 - p));
+}
+
+/**
+ * @brief p95 of the wait at the worst station, the figure the optimizer
+ * keeps low.
+ */
+static inline double
+model_p95(const model_t *m) {
+    double worst = 0;
+    it(i, 0, NOF_STATIONS) {
+        const double q = model_wait_quantile(&m->st[i], 0.95);
+        if (q > worst)
+            worst = q;
+    }
+    return worst;
+}
+
+#endif
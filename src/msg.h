@@ -4,6 +4,7 @@
 #include "objects.h"
 #include "tools.h"
 #include <stddef.h>
+#include <stdint.h>
 #include <sys/msg.h>
 #include <unistd.h>
 #include <errno.h>
@@ -14,6 +15,22 @@ typedef enum {
     DEFAULT = 3
 } priority_t;
 
+/*
+ * SESF classes: trays of one, two and three or more dishes. They share the
+ * mtype range of priority_t so that -DEFAULT still receives every request,
+ * but a station has one discipline and never mixes them with ticket classes.
+ */
+typedef enum {
+    SESF_LIGHT  = 1,
+    SESF_MEDIUM = 2,
+    SESF_FULL   = 3
+} tray_class_t;
+
+_Static_assert(
+    SESF_LIGHT >= HIGH && SESF_FULL <= DEFAULT,
+    "SESF classes must be received by msgrcv(-DEFAULT)"
+);
+
 typedef enum {
     ERROR                      = -1,
     RESPONSE_OK                =  0,
@@ -22,21 +39,78 @@ typedef enum {
     RESPONSE_CATEGORY_FINISHED = -3
 } state_t;
 
+/* Which member of the msg_t union is valid */
+typedef enum {
+    BODY_DISH      = 0,
+    BODY_GROUP_PAY = 1
+} msg_body_t;
+
 typedef struct {
     long   mtype;  
     pid_t  client;
     int    status; 
-    dish_t dish;
+    union {
+        dish_t dish;
+        // cassa con GROUP_CHECKOUT: pagamento unico per tutto il gruppo
+        struct {
+            size_t ticket_price; // parte di price pagata da membri con ticket
+            size_t members;      // membri pagati
+        } pay;
+    };
     size_t price;
     bool   ticket;
+    // piatti sul vassoio, stima della durata del pagamento
+    uint8_t  items;
+    // msg_body_t: dish o pay
+    uint8_t  body;
+    // zstamp() all'invio, per misurare l'attesa in coda
+    uint32_t sent_at;
+    // items, body e sent_at stanno nel padding dopo ticket: la coda ha un limite
+    // in byte (msgmnb) e un messaggio piu' grande ne riduce la capienza
 } msg_t;
 
+/* ticket, items, body e sent_at devono stare in un'unica parola */
+_Static_assert(
+    sizeof(msg_t) == offsetof(msg_t, ticket) + sizeof(size_t),
+    "msg_t trailing fields must fit in the padding after ticket"
+);
+
+/**
+ * Queue class of a request, used for the per-class statistics.
+ */
+static inline size_t
+req_class(const msg_t *msg) {
+    return msg->ticket ? 0 : 1;
+}
+
+/**
+ * mtype a client uses for a request, so that workers receiving with -DEFAULT
+ * (lowest mtype first, FIFO within a mtype) see the discipline's order.
+ * Aging and WFQ keep the two classes apart and pick between them on the
+ * worker side.
+ */
+static inline long
+request_mtype(const queue_discipline_t qd, const bool ticket, const size_t items) {
+    switch (qd) {
+    case QD_FIFO:
+        return DEFAULT;
+    case QD_SESF:
+        return items <= 1 ? SESF_LIGHT : items == 2 ? SESF_MEDIUM : SESF_FULL;
+    case QD_PRIORITY:
+    case QD_AGING:
+    case QD_WFQ:
+    default:
+        return ticket ? TICKET : DEFAULT;
+    }
+}
+
 static int
 send_msg(
     const size_t     qid,
-    const msg_t      msg,
+    msg_t            msg,
     const size_t     msg_size
 ) {
+    msg.sent_at = zstamp();
     if (msgsnd((int)qid, &msg, msg_size, 0) == -1) {
         if (errno == EINTR || errno == EIDRM || errno == EINVAL) {
             return -1;
@@ -82,4 +156,27 @@ recv_msg_np(
     return res;
 }
 
+/**
+ * Puts a request back in a queue keeping its original send time.
+ */
+static int
+resend_msg(const size_t qid, const msg_t *msg) {
+    const size_t m_size = sizeof(msg_t) - sizeof(long);
+    return msgsnd((int)qid, msg, m_size, 0);
+}
+
+/**
+ * Like recv_msg_np but never blocks: returns -1 (errno ENOMSG) when no
+ * message of the requested type is waiting.
+ */
+static ssize_t
+try_recv_msg(
+    const size_t qid,
+    const long   mtype,
+    msg_t *out
+) {
+    const ssize_t m_size = sizeof(msg_t) - sizeof(long);
+    return msgrcv((int)qid, out, m_size, mtype, IPC_NOWAIT);
+}
+
 #endif // _MSG_H
@@ -2,6 +2,8 @@
 #define _OBJECTS_H
 
 #include "const.h"
+#include <stdbool.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 #define DISH_NAME_MAX_LEN 32
@@ -12,20 +14,32 @@ union _semun {
     unsigned short  *array;
 };
 
-#define SEM_CNT 7
+#define SEM_CNT 4
 typedef enum {
     shm      = 0,
     out      = 1,
-    tbl      = 2,
-    wall     = 3,
-    wk_end   = 4,
-    cl_end   = 5,
-    disorder = 6,
+    tbl      = 2, // del giorno, ricreato a ogni apertura
+    disorder = 3,
 } ctx_sem;
 
-typedef int    sem_t;
+// Semaforo = indice in un set SysV condiviso, vedi sem_pool_t
+typedef struct {
+    int            set;
+    unsigned short idx;
+} sem_t;
 typedef size_t shmid_t;
 
+// Capienza di un set: semafori del contesto e due per stazione (stazione e
+// posti), basta sia per il set permanente sia per quello del giorno
+#define SEM_POOL_SIZE (SEM_CNT + 2 * NOF_STATIONS)
+
+// Set da cui sem_init assegna i semafori, vive nel processo main
+typedef struct {
+    int            set;
+    unsigned short used;
+    unsigned short val[SEM_POOL_SIZE]; // valori iniziali, scritti al commit
+} sem_pool_t;
+
 // incorpora sia i tipi di stazioni sia dove puo' trovarsi un utente.
 // nel caso delle stazioni 'TABLE' e' ignorato
 typedef enum {
@@ -42,15 +56,40 @@ struct pair_station {
     int   avg_time;
 };
 
+// cosa sta facendo un worker, letto dal responsabile per decidere chi spostare
+typedef enum {
+    WK_IDLE    = 0, // in attesa di una richiesta o di un posto alla stazione
+    WK_SERVING = 1,
+    WK_BREAK   = 2
+} wk_activity_t;
+
+// Disciplina con cui i worker scelgono la prossima richiesta della coda
+typedef enum {
+    QD_FIFO = 0, // ordine di arrivo
+    QD_PRIORITY, // prima chi ha il ticket
+    QD_AGING,    // prima chi ha il ticket, finche' gli altri non aspettano troppo
+    QD_WFQ,      // classi servite in proporzione ai pesi
+    QD_SESF,     // solo cassa: prima il vassoio piu' leggero
+    NOF_QD
+} queue_discipline_t;
+
+// I worker sono indicizzati globalmente: il worker idx occupa lo slot idx
+// del segmento della stazione in cui si trova (pid == 0 se lo slot e' vuoto),
+// cosi' puo' spostarsi tra stazioni senza collisioni.
 typedef struct {
     pid_t pid;
 
     loc_t  role;
     size_t queue;
-
-    bool   paused;
-    size_t nof_pause;
-    size_t pause_time; // cumulative time spent on pause
+    // stazione richiesta dal responsabile, == role se non ci sono spostamenti
+    loc_t  next_role;
+
+    bool          paused;
+    wk_activity_t activity;
+    size_t        nof_pause;
+    size_t        pause_time; // cumulative time spent on pause
+    // worker extra avviato dall'autoscaling, esce a fine giornata
+    bool          elastic;
 } worker_t;
 
 typedef struct {
@@ -70,12 +109,31 @@ typedef struct {
     size_t eating_time;
 } dish_t;
 
+typedef enum { FIRST = 0, MAIN = 1, COFFEE = 2 } dish_type;
+
 typedef struct {
-    size_t id;
-    size_t quantity;
-} dish_avl_t;
+    dish_t info;
+    size_t quantity; // Read && Write, under sem[shm]
+} dish_slot_t;
+
+// Catalogo dei piatti, in un segmento dedicato perche' la sua dimensione
+// dipende da menu.json. Gli slot sono raggruppati per categoria e seguiti
+// da un indice denso id -> slot (-1 se l'id non esiste), cosi' la ricerca
+// di un piatto e' O(1) indipendentemente dalla dimensione del menu.
+typedef struct {
+    struct {
+        size_t first;  // primo slot della categoria
+        size_t size;   // numero di piatti della categoria
+        size_t index;  // primo elemento della categoria nell'indice
+        size_t nof_id; // max id + 1
+    } cat[MENU_CATEGORIES];
 
-typedef enum { FIRST = 0, MAIN = 1, COFFEE = 2 } dish_type;
+    size_t nof_slots;
+    size_t index_len;
+
+    // dish_slot_t slots[nof_slots], poi ssize_t index[index_len]
+    dish_slot_t slots[];
+} menu_t;
 
 typedef struct {
     size_t worked_time;
@@ -83,6 +141,17 @@ typedef struct {
     size_t earnings;
     size_t total_breaks;
     size_t users_not_served;
+    size_t transfers; // worker arrivati da altre stazioni
+    size_t stolen;    // richieste servite da worker di altre stazioni
+    size_t scale_up;      // worker elastici avviati per la stazione
+    size_t scale_down;    // worker elastici congedati dalla stazione
+    size_t elastic_time;  // minuti-worker pagati per gli elastici
+    size_t forced_breaks; // pause per scadenza, anche a coda piena o da soli
+    size_t payments;      // transazioni di pagamento servite in cassa
+    size_t queue_peak;    // massimo di richieste in coda nel giorno
+    size_t backlog;       // richieste ancora in coda a fine giornata
+    size_t stockouts;     // richieste respinte perche' il piatto era finito
+    size_t wait_hist[REQ_CLASSES][WAIT_BUCKETS]; // attese in coda per classe
 } stats;
 
 typedef struct {
@@ -97,6 +166,16 @@ typedef struct {
     stats total_stats;
     loc_t type;
 
+    // attese (in minuti) delle richieste ricevute dall'ultimo controllo del
+    // responsabile, per il p95 dell'autoscaling
+    size_t wait_win[WAIT_BUCKETS];
+
+    // aging: richieste tenute da parte dai worker, fuori dalla coda (atomico)
+    size_t held;
+
+    // WFQ: tempo virtuale raggiunto da ogni classe di richieste
+    size_t wfq_pass[REQ_CLASSES];
+
     struct {
         shmid_t shmid;
         size_t  cap;
@@ -104,8 +183,6 @@ typedef struct {
         // per gestire il massimo di lavoratori attivi (le pause)
         sem_t sem;
     } wk_data;
-
-    dish_t menu[DISHES_COUNT];
 } station;
 
 typedef struct {
@@ -135,6 +212,10 @@ typedef struct {
     // coffee;
     // cassa;
 
+    // Worker assegnati a ogni stazione, tutti 0 = ripartiti da worker_split
+    // in base ai tempi di servizio
+    int nof_wk_roles[NOF_STATIONS];
+
     int nof_tbl_seats;
 
     // Logistica Cibo & Versione Completa
@@ -148,39 +229,177 @@ typedef struct {
     int disorder_duration;
     int n_new_users;
 
+    // Politiche del responsabile (opzionali)
+    int rebalance_interval; // minuti tra due ribilanciamenti, 0 = disattivo
+
+    // Tra un giorno e l'altro: 1 = ripartizione dei worker e rifornimenti
+    // ricalcolati da carico, code ed esauriti del giorno prima (adapt_day)
+    int adaptive_staffing;
+
+    // Work stealing: un worker inattivo serve le code delle stazioni per cui
+    // skills[propria stazione][stazione] e' vero
+    int  work_stealing;
+    bool skills[NOF_STATIONS][NOF_STATIONS];
+
+    // Autoscaling: fino a autoscale_budget worker extra in tutto, controllati
+    // ogni autoscale_interval minuti; si aggiunge un worker quando la coda
+    // supera autoscale_backlog richieste per worker o il p95 dell'attesa
+    // supera autoscale_p95_wait minuti (0 = ignorato)
+    int autoscale_budget;
+    int autoscale_interval;
+    int autoscale_backlog;
+    int autoscale_p95_wait;
+
+    // Pause: 0 = lancio di moneta al 15% dopo ogni cliente, 1 = pause
+    // spostate nei momenti di coda bassa con garanzia entro fine giornata
+    int break_policy;
+
+    // Code: disciplina di ogni stazione, soglia dell'aging in minuti e peso
+    // WFQ di ogni classe (ticket, senza ticket)
+    queue_discipline_t queue_discipline[NOF_STATIONS];
+    int                aging_minutes;
+    int                wfq_weight[REQ_CLASSES];
+
+    // Cassa: 1 = l'ultimo membro arrivato paga per tutto il gruppo
+    int group_checkout;
+    // Cassa: 1 = durata del pagamento proporzionale ai piatti sul vassoio
+    // (di default solo con QUEUE_CASSA sesf, che ordina per vassoio)
+    int checkout_by_items;
+
+    // Arrivi: 0 punti = tutti i gruppi entrano a inizio giornata, altrimenti
+    // processo di Poisson col tasso (utenti al minuto) interpolato tra i punti
+    // {minuto, tasso} del profilo, costante prima del primo e dopo l'ultimo
+    int    arrival_points;
+    double arrival_profile[ARRIVAL_MAX_POINTS][2];
+
 } conf_t;
 
+// Record/replay delle estrazioni casuali (trace.h)
+typedef enum {
+    TRACE_OFF,
+    TRACE_RECORD, // le estrazioni vanno nella traccia
+    TRACE_REPLAY, // le estrazioni vengono dalla traccia
+} trace_mode_t;
+
+// Bit di trace_client_t.set: uno per stazione (srvc valido) e i piatti
+#define TRACE_DISHES (1u << NOF_STATIONS)
+
+// Estrazioni di un cliente nella giornata
+typedef struct {
+    int32_t  dishes[MENU_CATEGORIES]; // piatti scelti, -1 = saltato
+    uint32_t srvc[NOF_STATIONS];      // rand() del tempo di servizio
+    uint32_t set;                     // campi validi, atomico
+    uint32_t used;                    // srvc gia' usati oggi, non salvato
+} trace_client_t;
+
+// Segmento condiviso della traccia, una giornata alla volta
+typedef struct {
+    uint32_t misses; // estrazioni cercate e assenti in replay, atomico
+    uint32_t reused; // tempi di servizio ripetuti nella stessa stazione, atomico
+    // pid << 32 | indice del cliente, 0 = libero, scritto dal cliente con
+    // una CAS
+    uint64_t pids[TRACE_PID_SLOTS];
+    trace_client_t client[MAX_TOTAL_USERS];
+} trace_t;
+
+// Stato di arrivo di un gruppo nella giornata, parola futex
+typedef enum {
+    ARRIVAL_WAIT,      // non ancora entrato, i membri dormono
+    ARRIVAL_IN,        // entrato, i membri vanno alle stazioni
+    ARRIVAL_CANCELLED, // giornata finita prima del suo arrivo
+} arrival_t;
+
+// Esito della simulazione, e' anche il codice di uscita del main: fuori dal
+// range di errno, che panic usa come codice di uscita
+typedef enum {
+    RUN_COMPLETED   = 0,   // raggiunta la durata prevista
+    RUN_OVERLOAD    = 200, // troppi utenti rimasti a fine giornata
+    RUN_DISORDER    = 201, // cassa bloccata dal disorder alla fine
+    RUN_INTERRUPTED = 202, // tasto q, SIGINT o SIGTERM
+} run_outcome_t;
+
+// Fotografia delle metriche del giorno per la dashboard, scritta solo dal
+// responsabile a ogni tick e letta con snap_read (seqlock, vedi tools.h):
+// chi la legge non tocca semafori, code e stazioni
+typedef struct {
+    bool   running;      // false a simulazione finita, i viewer escono
+    bool   disorder;
+    size_t day;          // giorno corrente, da 1
+    size_t days;         // durata della simulazione
+    size_t min;
+    size_t users_total;
+    size_t users_in;
+    size_t not_served;
+    size_t seated;       // clienti seduti ai tavoli
+    size_t arrivals;     // arrivi di nuovi utenti finora
+    size_t last_arrival; // utenti dell'ultimo arrivo
+    struct {
+        size_t served;
+        size_t breaks;
+        size_t worked_time;
+        size_t earnings;
+        size_t queued;    // richieste in coda
+        size_t active;    // posti occupati
+        size_t cap;       // worker assegnati
+        size_t workers;   // worker presenti negli slot
+        size_t paused;    // di cui in pausa
+        size_t leftovers; // porzioni rimaste (primi e secondi)
+    } st[NOF_STATIONS];
+} snapshot_t;
+
 typedef struct {
     stats  global_stats;
     conf_t config;
 
     sem_t sem[SEM_CNT];
 
-    // Read && Write
-    struct available_dishes {
-        dish_avl_t data[MAX_ELEMENTS];
-        size_t     size;
-    } avl_dishes[3];
+    // catalogo e giacenze (menu_t)
+    shmid_t menu_shm;
 
-    // ONLY READ
-    struct {
-        dish_t data[MAX_ELEMENTS];
-        size_t size;
-    } menu[3];
+    // traccia di record/replay, trace_shm valido se trace_mode != TRACE_OFF
+    trace_mode_t trace_mode;
+    shmid_t      trace_shm;
+
+    // seme della simulazione, ogni processo ne deriva il suo (stream_seed)
+    uint32_t seed;
 
     size_t id_msg_q[NOF_STATIONS + 1];
 
     bool is_sim_running;
     bool is_day_running;
 
+    // Barriera di giornata (day_* in tools.h), parole futex condivise
+    struct {
+        uint32_t epoch;    // giorni aperti finora, worker e clienti ci dormono
+        uint32_t open;     // 1 durante la giornata, day_sleep ci dorme
+        uint32_t pending;  // worker e clienti non ancora usciti dal giorno
+        uint32_t users_in; // clienti che non hanno finito la giornata
+        uint32_t gone;     // figli morti durante una giornata, fuori dalle
+                           // successive (solo il responsabile)
+    } day;
+    // minuto della giornata, aggiornato dal responsabile a ogni tick
+    size_t current_min;
+
     bool   is_disorder_active;
-    size_t added_users;
+
+    // Metriche per la dashboard, seq e' dispari mentre il responsabile scrive
+    struct {
+        uint32_t   seq;
+        snapshot_t data;
+    } snap;
     
     struct groups_t {
         size_t id;
         size_t total_members;
-        size_t members_ready;
-        sem_t  sem;
+        uint32_t members_ready; // arrivi in cassa, atomico
+        uint32_t generation;    // parola futex, cresce a ogni rilascio
+        uint32_t arrival;       // arrival_t, scritto solo dal responsabile
+
+        // pagamento di gruppo, accumulato dai membri arrivati in cassa
+        size_t pay_price;
+        size_t pay_ticket_price;
+        size_t pay_items;
+        size_t pay_tickets;
     } groups[];
 
 } simctx_t;
@@ -0,0 +1,310 @@
+#include "cJSON.h"
+#include "config.h"
+#include "menu.h"
+#include "model.h"
+#include "tools.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* =========================================================================
+ * Staffing optimizer
+ * Tries every split of a headcount among the stations, at least one worker
+ * each, on the queueing model of model.h and keeps the best: the lowest p95
+ * wait at the worst station, or the fewest unserved users, the other figure
+ * breaking ties. With -t it looks for the smallest headcount within the
+ * budget whose best split keeps the p95 under the target (more workers never
+ * make the best split worse, so a bisection is enough). With -s the seats
+ * of every station follow its workers: the model never does worse with a
+ * seat per worker. The result is the base config with NOF_WORKERS and the
+ * NOF_WORKERS_* split (and the seats) set, ready for main.
+ * ========================================================================= */
+
+#define OPT_OUT_DEFAULT "data/optimized.json"
+#define OPT_TOP 5
+
+typedef enum { OBJ_P95, OBJ_UNSERVED } objective_t;
+
+typedef struct {
+    int     roles[NOF_STATIONS];
+    double  p95;
+    double  unserved;
+    double  peak; // utilizzo della stazione piu' carica
+    model_t model;
+} candidate_t;
+
+static const char *g_role_keys[NOF_STATIONS] = {
+    "NOF_WORKERS_PRIMI", "NOF_WORKERS_SECONDI", "NOF_WORKERS_COFFEE",
+    "NOF_WORKERS_CASSA"
+};
+static const char *g_seat_keys[NOF_STATIONS] = {
+    "NOF_WK_SEATS_PRIMI", "NOF_WK_SEATS_SECONDI", "NOF_WK_SEATS_COFFEE",
+    "NOF_WK_SEATS_CASSA"
+};
+
+static void
+usage(const char *prog) {
+    panic(
+        "Usage: %s [-b workers] [-m p95|unserved] [-t p95_minutes] [-s] "
+        "[-o out_config] base_config\n",
+        prog
+    );
+}
+
+/**
+ * @brief Tells whether a is a better staffing than b.
+ * * Equal figures (or both infinite) fall to the other objective, then to the
+ * more balanced load.
+ */
+static bool
+better(const candidate_t *a, const candidate_t *b, const objective_t obj) {
+    const double keys[2][2] = {
+        {obj == OBJ_P95 ? a->p95 : a->unserved,
+         obj == OBJ_P95 ? a->unserved : a->p95},
+        {obj == OBJ_P95 ? b->p95 : b->unserved,
+         obj == OBJ_P95 ? b->unserved : b->p95},
+    };
+
+    it(k, 0, 2) {
+        if (keys[0][k] == keys[1][k] || fabs(keys[0][k] - keys[1][k]) < 1e-9)
+            continue;
+        return keys[0][k] < keys[1][k];
+    }
+    return a->peak < b->peak;
+}
+
+/**
+ * @brief Evaluates a config on the model.
+ */
+static void
+evaluate(
+    const conf_t *conf, const size_t menu_size[MENU_CATEGORIES], candidate_t *c
+) {
+    model_estimate(conf, menu_size, &c->model);
+    c->p95      = model_p95(&c->model);
+    c->unserved = c->model.unserved;
+    c->peak     = 0;
+    it(i, 0, NOF_STATIONS) {
+        if (c->model.st[i].rho > c->peak)
+            c->peak = c->model.st[i].rho;
+    }
+}
+
+/**
+ * @brief Sets the split (and with follow_seats the seats) of a candidate
+ * into a config.
+ */
+static void
+apply(conf_t *conf, const int *roles, const bool follow_seats) {
+    conf->nof_workers = 0;
+    it(i, 0, NOF_STATIONS) {
+        conf->nof_wk_roles[i] = roles[i];
+        conf->nof_workers += roles[i];
+        if (follow_seats)
+            conf->nof_wk_seats[i] = roles[i];
+    }
+}
+
+/**
+ * @brief Tries every split of `workers` and keeps the best OPT_TOP.
+ * @param top Output, best first.
+ * @return Number of candidates in top.
+ */
+static size_t
+search(
+    const conf_t     *base,
+    const size_t      menu_size[MENU_CATEGORIES],
+    const int         workers,
+    const objective_t obj,
+    const bool        follow_seats,
+    candidate_t       top[OPT_TOP]
+) {
+    conf_t      conf = *base;
+    candidate_t c;
+    size_t      n = 0;
+
+    it(a, 1, workers - 2) it(b, 1, workers - a - 1) it(d, 1, workers - a - b) {
+        c.roles[FIRST_COURSE] = a;
+        c.roles[MAIN_COURSE]  = b;
+        c.roles[COFFEE_BAR]   = d;
+        c.roles[CHECKOUT]     = workers - a - b - d;
+        apply(&conf, c.roles, follow_seats);
+        evaluate(&conf, menu_size, &c);
+
+        /* Insertion in the ranking */
+        size_t at = n;
+        while (at > 0 && better(&c, &top[at - 1], obj)) at--;
+        if (at == OPT_TOP)
+            continue;
+        if (n < OPT_TOP)
+            n++;
+        memmove(&top[at + 1], &top[at], (n - 1 - at) * sizeof(candidate_t));
+        top[at] = c;
+    }
+    return n;
+}
+
+/**
+ * @brief Prints one staffing as a row of the results table.
+ */
+static void
+print_row(const char *label, const candidate_t *c) {
+    char p95[16];
+    if (isinf(c->p95))
+        snprintf(p95, sizeof(p95), "overload");
+    else
+        snprintf(p95, sizeof(p95), "%.1f", c->p95);
+
+    printf(
+        "%-9s %5d %5d %5d %5d %9s %9.1f %7.0f%%\n", label,
+        c->roles[FIRST_COURSE], c->roles[MAIN_COURSE], c->roles[COFFEE_BAR],
+        c->roles[CHECKOUT], p95, c->unserved, c->peak * 100
+    );
+}
+
+/**
+ * @brief Writes the base config with the chosen staffing.
+ */
+static void
+write_config(
+    const char *base_path, const char *out_path, const candidate_t *best,
+    const bool follow_seats
+) {
+    char  *text = read_file(base_path);
+    cJSON *json = cJSON_Parse(text);
+    free(text);
+    if (json == NULL)
+        panic("ERROR: Unable to read the config %s\n", base_path);
+
+    int workers = 0;
+    it(i, 0, NOF_STATIONS) workers += best->roles[i];
+
+    cJSON_ReplaceItemInObjectCaseSensitive(
+        json, "NOF_WORKERS", cJSON_CreateNumber(workers)
+    );
+    it(i, 0, NOF_STATIONS) {
+        cJSON *roles = cJSON_CreateNumber(best->roles[i]);
+        if (cJSON_GetObjectItemCaseSensitive(json, g_role_keys[i]))
+            cJSON_ReplaceItemInObjectCaseSensitive(json, g_role_keys[i], roles);
+        else
+            cJSON_AddItemToObject(json, g_role_keys[i], roles);
+
+        if (follow_seats)
+            cJSON_ReplaceItemInObjectCaseSensitive(
+                json, g_seat_keys[i], cJSON_CreateNumber(best->roles[i])
+            );
+    }
+
+    char *out  = cJSON_Print(json);
+    FILE *file = zfopen(out_path, "w");
+    fprintf(file, "%s\n", out);
+    fclose(file);
+    free(out);
+    cJSON_Delete(json);
+}
+
+int
+main(int argc, char **argv) {
+    const char *out_path     = OPT_OUT_DEFAULT;
+    objective_t obj          = OBJ_P95;
+    int         budget       = 0;
+    double      target       = -1;
+    bool        follow_seats = false;
+    int         opt;
+
+    while ((opt = getopt(argc, argv, "b:m:t:so:")) != -1) {
+        switch (opt) {
+        case 'b':
+            budget = atoi(optarg);
+            break;
+        case 'm':
+            if (strcmp(optarg, "p95") == 0)
+                obj = OBJ_P95;
+            else if (strcmp(optarg, "unserved") == 0)
+                obj = OBJ_UNSERVED;
+            else
+                usage(argv[0]);
+            break;
+        case 't':
+            target = atof(optarg);
+            break;
+        case 's':
+            follow_seats = true;
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind >= argc)
+        usage(argv[0]);
+
+    conf_t conf = {0};
+    size_t menu_size[MENU_CATEGORIES];
+    load_config(argv[optind], &conf);
+    menu_sizes(MENU_FILE, menu_size);
+
+    if (budget == 0)
+        budget = conf.nof_workers;
+    if (budget < NOF_STATIONS)
+        panic("ERROR: At least %d workers, one per station\n", NOF_STATIONS);
+
+    /* The staffing of the base config, as main would split it */
+    candidate_t now;
+    size_t      cap[NOF_STATIONS];
+    worker_split(&conf, cap);
+    it(i, 0, NOF_STATIONS) now.roles[i] = (int)cap[i];
+    evaluate(&conf, menu_size, &now);
+
+    candidate_t top[OPT_TOP];
+    size_t n = search(&conf, menu_size, budget, obj, follow_seats, top);
+    int    workers = budget;
+
+    /* Smallest headcount meeting the target: bisection over [4, budget] */
+    if (target >= 0 && top[0].p95 <= target) {
+        int lo = NOF_STATIONS, hi = budget;
+        while (lo < hi) {
+            const int   mid = (lo + hi) / 2;
+            candidate_t probe[OPT_TOP];
+            search(&conf, menu_size, mid, obj, follow_seats, probe);
+            if (probe[0].p95 <= target)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        workers = lo;
+        n       = search(&conf, menu_size, workers, obj, follow_seats, top);
+    }
+
+    printf(
+        "[OPTIMIZE] %d workers, %.0f users a day, objective %s%s\n", workers,
+        top[0].model.users, obj == OBJ_P95 ? "p95 wait" : "unserved users",
+        follow_seats ? ", seats follow the workers" : ""
+    );
+    printf(
+        "%-9s %5s %5s %5s %5s %9s %9s %8s\n", "", "FIRST", "MAIN", "COFFEE",
+        "CASSA", "P95(min)", "UNSERVED", "PEAK"
+    );
+    print_row("current", &now);
+    it(i, 0, n) {
+        char label[16];
+        snprintf(label, sizeof(label), "#%d", i + 1);
+        print_row(label, &top[i]);
+    }
+
+    write_config(argv[optind], out_path, &top[0], follow_seats);
+    printf("[OPTIMIZE] Best staffing written to %s\n", out_path);
+
+    if (target >= 0 && top[0].p95 > target) {
+        printf(
+            "[OPTIMIZE] p95 target of %.1f min not met within %d workers\n",
+            target, budget
+        );
+        return 1;
+    }
+    return top[0].model.stable ? 0 : 1;
+}
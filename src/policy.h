@@ -0,0 +1,390 @@
+#ifndef _POLICY_H
+#define _POLICY_H
+
+#include <math.h>
+#include <signal.h>
+#include <string.h>
+
+#include "const.h"
+#include "model.h"
+#include "objects.h"
+#include "tools.h"
+
+/* =========================================================================
+ * Coordinator policies
+ * Decisions the responsabile takes while a day is running, on top of the
+ * static split computed by assign_roles, and between two days when the
+ * staffing adapts to what the last one asked for.
+ * ========================================================================= */
+
+/* Minimum queued requests before a station is worth pulling a worker in */
+#define REBALANCE_MIN_BACKLOG 2
+
+/* Share of the way to the target roster covered every day by adapt_day */
+#define ADAPT_STEP 0.5
+
+/**
+ * @brief Moves one idle or paused worker to the most backlogged station.
+ * * Stations are ranked by queued requests per assigned worker. The donor is
+ * the least loaded station that can spare someone (it keeps at least one
+ * worker) and is clearly less loaded than the target; the moved worker must
+ * be waiting for a request on an empty queue or waiting for a free seat.
+ * Moving is only worth it if the target has a free seat to work at. The
+ * worker is flagged through next_role and woken with SIGUSR1, it then
+ * changes role, queue and station slot by itself (see migrate in worker.c).
+ * * @param ctx Global context.
+ * @param st Stations array.
+ * @return true if a transfer was requested.
+ */
+static bool
+rebalance_workers(const simctx_t *ctx, station *st) {
+    size_t backlog[NOF_STATIONS];
+    double pressure[NOF_STATIONS];
+    int    target = -1;
+
+    it(i, 0, NOF_STATIONS) {
+        const size_t cap = st[i].wk_data.cap ? st[i].wk_data.cap : 1;
+
+        backlog[i]  = station_backlog(ctx, &st[i]);
+        pressure[i] = (double)backlog[i] / (double)cap;
+
+        if (backlog[i] >= REBALANCE_MIN_BACKLOG &&
+            (target == -1 || pressure[i] > pressure[target]))
+            target = i;
+    }
+
+    if (target == -1 || sem_getval(st[target].wk_data.sem) == 0)
+        return false;
+
+    bool tried[NOF_STATIONS] = {false};
+    tried[target]            = true;
+
+    it(attempt, 0, NOF_STATIONS - 1) {
+        /* Next least loaded station not tried yet */
+        int donor = -1;
+        it(i, 0, NOF_STATIONS) {
+            if (!tried[i] && (donor == -1 || pressure[i] < pressure[donor]))
+                donor = i;
+        }
+        tried[donor] = true;
+
+        if (st[donor].wk_data.cap <= 1 ||
+            pressure[donor] + 1.0 > pressure[target])
+            continue;
+
+        worker_t *wks = get_workers(st[donor].wk_data.shmid);
+        it(j, 0, wk_slots(&ctx->config)) {
+            worker_t *wk = &wks[j];
+            if (wk->pid == 0 || wk->next_role != wk->role ||
+                wk->activity != WK_IDLE)
+                continue;
+
+            /* Waiting on a non-empty queue means it's between two clients */
+            if (!wk->paused && backlog[donor] > 0)
+                continue;
+
+            const pid_t pid = wk->pid;
+            wk->next_role   = (loc_t)target;
+            kill(pid, SIGUSR1);
+
+            zprintf(
+                ctx->sem[out],
+                "MAIN: Moving worker %d from station %d (queue %zu) to "
+                "station %d (queue %zu)\n",
+                pid, donor, backlog[donor], target, backlog[target]
+            );
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Wakes idle workers that may steal from a backlogged station.
+ * * A worker blocked on its own empty queue only looks at the other queues
+ * when it gets back to the top of its loop, so the coordinator interrupts
+ * it with SIGUSR1 (see steal_request in worker.c). Paused workers hold no
+ * seat and are left alone. At most one worker per queued request is woken.
+ * * @param ctx Global context.
+ * @param st Stations array.
+ */
+static void
+nudge_stealers(const simctx_t *ctx, station *st) {
+    size_t backlog[NOF_STATIONS];
+    size_t wanted = 0;
+
+    it(i, 0, NOF_STATIONS) {
+        backlog[i] = zmsgqnum(ctx->id_msg_q[i]);
+        wanted += backlog[i];
+    }
+
+    it(thief, 0, NOF_STATIONS) {
+        if (wanted == 0)
+            return;
+        if (backlog[thief] > 0)
+            continue;
+
+        bool useful = false;
+        it(victim, 0, NOF_STATIONS) {
+            if (victim != thief && backlog[victim] > 0 &&
+                ctx->config.skills[thief][victim])
+                useful = true;
+        }
+        if (!useful)
+            continue;
+
+        worker_t *wks = get_workers(st[thief].wk_data.shmid);
+        for (size_t j = 0; j < wk_slots(&ctx->config) && wanted > 0; j++) {
+            const worker_t *wk = &wks[j];
+            if (wk->pid == 0 || wk->paused || wk->activity != WK_IDLE ||
+                wk->next_role != wk->role)
+                continue;
+
+            kill(wk->pid, SIGUSR1);
+            wanted--;
+        }
+    }
+}
+
+/**
+ * @brief Wakes idle workers whose next break has become eligible.
+ * * The load aware break policy decides between two clients, so a worker
+ * blocked on an empty queue would sleep through the quiet hours instead of
+ * resting. Only stations with an empty queue and more than one active worker
+ * are visited, the worker itself still checks the break rules.
+ * * @param ctx Global context.
+ * @param st Stations array.
+ */
+static void
+nudge_breaks(const simctx_t *ctx, station *st) {
+    it(i, 0, NOF_STATIONS) {
+        const int active = station_active(ctx, &st[i]);
+        if (active <= 1 || station_backlog(ctx, &st[i]) > 0)
+            continue;
+
+        worker_t *wks = get_workers(st[i].wk_data.shmid);
+        it(j, 0, wk_slots(&ctx->config)) {
+            const worker_t *wk = &wks[j];
+            if (wk->pid == 0 || wk->elastic || wk->paused ||
+                wk->activity != WK_IDLE || wk->next_role != wk->role ||
+                wk->nof_pause >= (size_t)ctx->config.nof_pause ||
+                ctx->current_min < break_slot(&ctx->config, wk->nof_pause))
+                continue;
+
+            kill(wk->pid, SIGUSR1);
+        }
+    }
+}
+
+/**
+ * @brief Checks every station against the autoscaling thresholds.
+ * * A station grows when its queue holds more than autoscale_backlog requests
+ * per assigned worker, or when the p95 of the waits seen since the previous
+ * check reaches autoscale_p95_wait, as long as it has fewer workers than
+ * seats. It is idle when nothing is queued and no request waited a minute.
+ * The wait window is cleared, so the next check only sees new requests.
+ * * @param ctx Global context.
+ * @param st Stations array.
+ * @param grow Output, stations that need one more worker.
+ * @param idle Output, stations that can give back an elastic worker.
+ */
+static void
+scale_check(
+    const simctx_t *ctx,
+    station        *st,
+    bool            grow[NOF_STATIONS],
+    bool            idle[NOF_STATIONS]
+) {
+    it(i, 0, NOF_STATIONS) {
+        sem_wait(st[i].sem);
+        const size_t p95 = hist_percentile(st[i].wait_win, 0.95);
+        memset(st[i].wait_win, 0, sizeof(st[i].wait_win));
+        const size_t cap = st[i].wk_data.cap;
+        sem_signal(st[i].sem);
+
+        const size_t backlog = station_backlog(ctx, &st[i]);
+        const bool   slow    = ctx->config.autoscale_p95_wait > 0 &&
+                          p95 >= (size_t)ctx->config.autoscale_p95_wait;
+        const bool   queued =
+            backlog > (size_t)ctx->config.autoscale_backlog * (cap ? cap : 1);
+
+        grow[i] = (queued || slow) && cap < (size_t)ctx->config.nof_wk_seats[i];
+        idle[i] = backlog == 0 && p95 == 0;
+    }
+}
+
+/**
+ * @brief Asks one elastic worker of an idle station to leave.
+ * * Only workers waiting for a request or for a seat are retired; the worker
+ * is flagged with next_role = EXIT and woken with SIGUSR1, it then frees its
+ * slot and exits (see work_elastic in worker.c).
+ * * @param ctx Global context.
+ * @param st Stations array.
+ * @param at Idle station.
+ * @return true if a worker was retired.
+ */
+static bool
+retire_elastic(const simctx_t *ctx, station *st, const loc_t at) {
+    worker_t *wks = get_workers(st[at].wk_data.shmid);
+
+    it(j, (size_t)ctx->config.nof_workers, wk_slots(&ctx->config)) {
+        worker_t *wk = &wks[j];
+        if (wk->pid == 0 || !wk->elastic || wk->next_role != wk->role ||
+            wk->activity != WK_IDLE)
+            continue;
+
+        const pid_t pid = wk->pid;
+        wk->next_role   = EXIT;
+        kill(pid, SIGUSR1);
+
+        zprintf(
+            ctx->sem[out], "MAIN: Retiring elastic worker %d from station %d\n",
+            pid, at
+        );
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Roster of the next day, moved ADAPT_STEP of the way from the
+ * current one to the split of the work asked to every station.
+ * * The work of a station is its worked minutes plus the requests left in
+ * its queue at closing, at the mean service time of the day. Every station
+ * keeps a worker and gets no more than its seats can use through the breaks,
+ * unless all of them are full; the rounding goes to the largest remainders.
+ * @param next Output, workers of every station, summing to NOF_WORKERS.
+ * @return false if the day did no work to learn from.
+ */
+static bool
+adapt_roster(const simctx_t *ctx, const station *st, int next[NOF_STATIONS]) {
+    const conf_t *conf = &ctx->config;
+    double        work[NOF_STATIONS], total = 0;
+
+    it(i, 0, NOF_STATIONS) {
+        const size_t done = i == CHECKOUT ? st[i].stats.payments
+                                          : st[i].stats.served_dishes;
+        const double srvc = done > 0
+                                ? (double)st[i].stats.worked_time / (double)done
+                                : (double)conf->avg_srvc[i];
+        work[i] = (double)st[i].stats.worked_time +
+                  (double)st[i].stats.backlog * srvc;
+        total += work[i];
+    }
+    if (total <= 0)
+        return false;
+
+    /* Workers a station keeps busy: its seats, plus the cover of the breaks */
+    const double off =
+        (double)conf->nof_pause * conf->pause_duration / WORK_DAY_MINUTES;
+    size_t cap[NOF_STATIONS];
+    double want[NOF_STATIONS];
+    int    usable[NOF_STATIONS], sum = 0;
+    worker_split(conf, cap);
+
+    it(i, 0, NOF_STATIONS) {
+        const double goal = conf->nof_workers * work[i] / total;
+        want[i]   = (double)cap[i] + ADAPT_STEP * (goal - (double)cap[i]);
+        usable[i] = off < 1 ? (int)ceil(conf->nof_wk_seats[i] / (1 - off))
+                            : conf->nof_workers;
+
+        next[i] = (int)want[i];
+        if (next[i] > usable[i])
+            next[i] = usable[i];
+        if (next[i] < 1)
+            next[i] = 1;
+        sum += next[i];
+    }
+
+    while (sum < conf->nof_workers) {
+        int to = -1;
+        it(i, 0, NOF_STATIONS) {
+            if (next[i] < usable[i] &&
+                (to == -1 || want[i] - next[i] > want[to] - next[to]))
+                to = i;
+        }
+        /* Every seat covered: the rest where the work is */
+        if (to == -1) {
+            it(i, 0, NOF_STATIONS) {
+                if (to == -1 || want[i] - next[i] > want[to] - next[to])
+                    to = i;
+            }
+        }
+        next[to]++;
+        sum++;
+    }
+    while (sum > conf->nof_workers) {
+        int from = -1;
+        it(i, 0, NOF_STATIONS) {
+            if (next[i] > 1 &&
+                (from == -1 || want[i] - next[i] < want[from] - next[from]))
+                from = i;
+        }
+        next[from]--;
+        sum--;
+    }
+    return true;
+}
+
+/**
+ * @brief Refill of the next day for a food category.
+ * * Requests turned away because the dish was over raise it by the portions
+ * missed over the refills of the day, per dish, up to MAX_PORZIONI; a stock
+ * still at MAX_PORZIONI at closing wasted refills and cuts it by a quarter.
+ */
+static int
+adapt_refill(
+    const simctx_t *ctx, const station *st, menu_t *menu, const dish_type c
+) {
+    const conf_t *conf    = &ctx->config;
+    const size_t  size    = menu->cat[c].size;
+    const double  refills = (double)WORK_DAY_MINUTES / conf->avg_refill_time;
+    const int     max     = conf->max_porzioni[c];
+    int           refill  = conf->avg_refill[c];
+
+    if (size == 0)
+        return refill;
+    if (st[c].stats.stockouts > 0)
+        refill += (int)ceil(st[c].stats.stockouts / (size * refills));
+    else if (menu_leftovers(menu, c) >= size * (size_t)max)
+        refill -= refill / 4;
+
+    if (refill > max)
+        refill = max;
+    return refill > 1 ? refill : 1;
+}
+
+/**
+ * @brief Adapts roster and refills to the day just ended
+ * (ADAPTIVE_STAFFING), see adapt_roster and adapt_refill.
+ * * Both are written into the config: assign_roles and the workers read the
+ * roster at the next opening, and the checkpoint carries them to a resumed
+ * run. The stats of the day must still be there.
+ */
+static void
+adapt_day(simctx_t *ctx, const station *st, menu_t *menu) {
+    int        roster[NOF_STATIONS];
+    const bool moved = adapt_roster(ctx, st, roster);
+    const int  first  = adapt_refill(ctx, st, menu, FIRST);
+    const int  second = adapt_refill(ctx, st, menu, MAIN);
+
+    sem_wait(ctx->sem[shm]);
+    if (moved)
+        memcpy(ctx->config.nof_wk_roles, roster, sizeof(roster));
+    ctx->config.avg_refill[FIRST] = first;
+    ctx->config.avg_refill[MAIN]  = second;
+    sem_signal(ctx->sem[shm]);
+
+    size_t cap[NOF_STATIONS];
+    worker_split(&ctx->config, cap);
+    zprintf(
+        ctx->sem[out],
+        "MAIN: Tomorrow's roster %zu/%zu/%zu/%zu, refill %d/%d\n",
+        cap[FIRST_COURSE], cap[MAIN_COURSE], cap[COFFEE_BAR], cap[CHECKOUT],
+        first, second
+    );
+}
+
+#endif
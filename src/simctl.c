@@ -0,0 +1,30 @@
+#include "control.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Generic client of the control socket: the arguments are joined into one
+ * command line, the reply is printed as is.
+ *   simctl stats
+ *   simctl set-param REBALANCE_INTERVAL 10
+ */
+int
+main(int argc, char **argv) {
+    if (argc < 2)
+        panic("Usage: %s <command> [args...]\n", argv[0]);
+
+    char   cmd[CTL_LINE_MAX] = "";
+    size_t len               = 0;
+    it(i, 1, argc) {
+        len += snprintf(
+            cmd + len, sizeof(cmd) - len, "%s%s", i > 1 ? " " : "", argv[i]
+        );
+        if (len >= sizeof(cmd))
+            panic("ERROR: Command too long\n");
+    }
+
+    char      reply[CTL_LINE_MAX];
+    const int res = ctl_request(cmd, reply, sizeof(reply));
+    printf("%s\n", reply);
+    return res == 0 ? 0 : 1;
+}
@@ -0,0 +1,679 @@
+#include "cJSON.h"
+#include "tools.h"
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* =========================================================================
+ * Parameter sweep
+ * Runs `main --headless` once for every combination of the swept config
+ * keys, at most `jobs` at a time, each in its own run directory, then joins
+ * their stats.csv into a single table with the parameters of the run.
+ *
+ * With -r K every combination is replicated K times, replication k with
+ * seed base+k, the same for every combination so they are compared on the
+ * same draws. replications.csv then gives, per combination, day and
+ * stats.csv column, the mean over the replications, the sample standard
+ * deviation and the 95% confidence interval of the mean (Student's t).
+ * ========================================================================= */
+
+#define SWEEP_MAX_PARAMS 8
+#define SWEEP_MAX_VALUES 64
+#define SWEEP_MAX_COLUMNS 64
+#define SWEEP_OUT_DEFAULT "data/sweep"
+/* Seconds the runs get to close after SIGTERM before they are killed */
+#define SWEEP_KILL_AFTER_S 10
+
+/* One swept key: numbers, or strings for the QUEUE_* disciplines */
+typedef struct {
+    char  key[64];
+    char *values[SWEEP_MAX_VALUES];
+    size_t nof_values;
+} param_t;
+
+typedef struct {
+    pid_t    pid; // 0 = not started or reaped
+    int      status;
+    size_t   combo[SWEEP_MAX_PARAMS];
+    size_t   rep;
+    uint32_t seed;
+} run_t;
+
+/* Running mean and squared deviations of one column (Welford) */
+typedef struct {
+    size_t n;
+    double mean;
+    double m2;
+} acc_t;
+
+/* Per station split of NOF_WORKERS, kept in step with a swept total */
+static const char *g_role_keys[NOF_STATIONS] = {
+    "NOF_WORKERS_PRIMI", "NOF_WORKERS_SECONDI", "NOF_WORKERS_COFFEE",
+    "NOF_WORKERS_CASSA"
+};
+
+/* Student's t, 97.5th percentile, for 1..30 degrees of freedom */
+static const double T975[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+static volatile sig_atomic_t g_stop = 0;
+static volatile sig_atomic_t g_kill = 0;
+
+static void
+handler_stop(int sig) {
+    (void)sig;
+    g_stop = 1;
+}
+
+static void
+handler_kill(int sig) {
+    (void)sig;
+    g_kill = 1;
+}
+
+static void
+usage(const char *prog) {
+    panic(
+        "Usage: %s [-j jobs] [-r replications] [-s seed] [-o out_dir] "
+        "base_config KEY=v1,v2,... KEY=from:to[:step] ...\n",
+        prog
+    );
+}
+
+/**
+ * @brief Reads and parses a whole JSON file, NULL if missing or invalid.
+ */
+static cJSON *
+read_json(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    const long size = zfsize(file);
+    char      *text = zmalloc((size_t)size + 1);
+    text[fread(text, 1, (size_t)size, file)] = '\0';
+    fclose(file);
+
+    cJSON *json = cJSON_Parse(text);
+    free(text);
+    return json;
+}
+
+/**
+ * @brief Parses KEY=v1,v2,... or KEY=from:to[:step] into a param_t.
+ */
+static void
+parse_param(const char *arg, param_t *p) {
+    const char *eq = strchr(arg, '=');
+    if (eq == NULL || eq == arg || (size_t)(eq - arg) >= sizeof(p->key))
+        panic("ERROR: Bad parameter `%s`, expected KEY=values\n", arg);
+
+    memcpy(p->key, arg, (size_t)(eq - arg));
+    p->key[eq - arg] = '\0';
+    p->nof_values    = 0;
+
+    const char *spec = eq + 1;
+    char       *end;
+    const long  from = strtol(spec, &end, 10);
+
+    if (end != spec && *end == ':') {
+        const long to   = strtol(end + 1, &end, 10);
+        long       step = 1;
+        if (*end == ':')
+            step = strtol(end + 1, &end, 10);
+        if (*end != '\0' || step <= 0 || to < from)
+            panic("ERROR: Bad range `%s`\n", arg);
+
+        for (long v = from; v <= to; v += step) {
+            if (p->nof_values == SWEEP_MAX_VALUES)
+                panic("ERROR: Too many values for %s\n", p->key);
+            p->values[p->nof_values++] = strdup(itos((int)v));
+        }
+        return;
+    }
+
+    char *list = strdup(spec);
+    for (char *tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+        if (p->nof_values == SWEEP_MAX_VALUES)
+            panic("ERROR: Too many values for %s\n", p->key);
+        p->values[p->nof_values++] = strdup(tok);
+    }
+    free(list);
+
+    if (p->nof_values == 0)
+        panic("ERROR: No values for %s\n", p->key);
+}
+
+/**
+ * @brief Sets key to value in the config, as a number when it parses as one.
+ */
+static void
+set_param(cJSON *conf, const char *key, const char *value) {
+    char      *end;
+    const long num  = strtol(value, &end, 10);
+    cJSON     *item = *end == '\0' ? cJSON_CreateNumber((double)num)
+                                   : cJSON_CreateString(value);
+
+    if (cJSON_GetObjectItemCaseSensitive(conf, key))
+        cJSON_ReplaceItemInObjectCaseSensitive(conf, key, item);
+    else
+        cJSON_AddItemToObject(conf, key, item);
+}
+
+/**
+ * @brief Fits the NOF_WORKERS_* split of the base config to a swept
+ * NOF_WORKERS, which it must sum to.
+ * * The split is rescaled to the new total by largest remainder, at least one
+ * worker per station. A sweep over the NOF_WORKERS_* keys is left as given,
+ * as is a total main rejects anyway.
+ */
+static void
+fit_roles(cJSON *conf, const param_t *params, const size_t nof_params) {
+    bool total_swept = false;
+    it(i, 0, nof_params) {
+        if (strncmp(params[i].key, "NOF_WORKERS_", 12) == 0)
+            return;
+        total_swept |= strcmp(params[i].key, "NOF_WORKERS") == 0;
+    }
+    if (!total_swept)
+        return;
+
+    double role[NOF_STATIONS], sum = 0;
+    it(i, 0, NOF_STATIONS) {
+        const cJSON *item = cJSON_GetObjectItemCaseSensitive(conf, g_role_keys[i]);
+        if (!cJSON_IsNumber(item) || item->valuedouble <= 0)
+            return; // no split, or a bad one main reports
+        role[i] = item->valuedouble;
+        sum += role[i];
+    }
+
+    const long total = (long)cJSON_GetNumberValue(
+        cJSON_GetObjectItemCaseSensitive(conf, "NOF_WORKERS")
+    );
+    if (total < NOF_STATIONS)
+        return;
+
+    long   n[NOF_STATIONS], given = 0;
+    double quota[NOF_STATIONS];
+    it(i, 0, NOF_STATIONS) {
+        quota[i] = role[i] * (double)total / sum;
+        n[i]     = quota[i] < 1 ? 1 : (long)quota[i];
+        given += n[i];
+    }
+    /* Largest remainder up, smallest down while a station keeps one */
+    while (given != total) {
+        const long step = given < total ? 1 : -1;
+        ssize_t    best = -1;
+        double     top  = 0;
+        it(i, 0, NOF_STATIONS) {
+            if (step < 0 && n[i] <= 1)
+                continue;
+            const double score = (quota[i] - (double)n[i]) * (double)step;
+            if (best == -1 || score > top) {
+                best = (ssize_t)i;
+                top  = score;
+            }
+        }
+        n[best] += step;
+        given += step;
+    }
+
+    it(i, 0, NOF_STATIONS) cJSON_ReplaceItemInObjectCaseSensitive(
+        conf, g_role_keys[i], cJSON_CreateNumber((double)n[i])
+    );
+}
+
+/**
+ * @brief Writes the config of a run into its directory and starts main.
+ * * stdout (the JSON summary) and stderr are kept in the run directory.
+ */
+static pid_t
+launch(
+    const cJSON   *base,
+    const param_t *params,
+    const size_t   nof_params,
+    const size_t  *combo,
+    const uint32_t seed,
+    const char    *dir
+) {
+    if (mkdir(dir, 0755) == -1 && errno != EEXIST)
+        panic("ERROR: Unable to create %s\n", dir);
+
+    cJSON *conf = cJSON_Duplicate(base, true);
+    it(i, 0, nof_params)
+        set_param(conf, params[i].key, params[i].values[combo[i]]);
+    fit_roles(conf, params, nof_params);
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/config.json", dir);
+    char *text = cJSON_Print(conf);
+    FILE *f    = zfopen(path, "w");
+    fprintf(f, "%s\n", text);
+    fclose(f);
+    free(text);
+    cJSON_Delete(conf);
+
+    const pid_t pid = zfork();
+    if (pid == 0) {
+        char out[PATH_MAX], err[PATH_MAX];
+        snprintf(out, sizeof(out), "%s/summary.json", dir);
+        snprintf(err, sizeof(err), "%s/stderr.txt", dir);
+
+        const int fd_out = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        const int fd_err = open(err, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd_out == -1 || fd_err == -1)
+            panic("ERROR: Unable to open the output of %s\n", dir);
+        dup2(fd_out, STDOUT_FILENO);
+        dup2(fd_err, STDERR_FILENO);
+        close(fd_out);
+        close(fd_err);
+
+        char seed_arg[16];
+        snprintf(seed_arg, sizeof(seed_arg), "%u", seed);
+
+        /* The sweep handles ^C for the whole batch */
+        setpgid(0, 0);
+        execl(
+            "./bin/main", "main", "--headless", "--run-dir", dir, "--seed",
+            seed_arg, path, NULL
+        );
+        panic("ERROR: Exec failed launching main\n");
+    }
+    return pid;
+}
+
+/**
+ * @brief Reads the stats.csv header of the first run that left one.
+ * * line is "\n" if no run did.
+ */
+static void
+stats_header(
+    const char *out_dir, const size_t nof_runs, char *line, const size_t len
+) {
+    char path[PATH_MAX];
+    strcpy(line, "\n");
+
+    it(r, 0, nof_runs) {
+        snprintf(path, sizeof(path), "%s/run_%04d/stats.csv", out_dir, r);
+        FILE *csv   = fopen(path, "r");
+        bool  found = csv && fgets(line, (int)len, csv);
+        if (csv)
+            fclose(csv);
+        if (found)
+            return;
+    }
+    strcpy(line, "\n");
+}
+
+/**
+ * @brief Writes the header of the results table.
+ * * The day columns are taken from the first run that left a stats.csv.
+ */
+static void
+merge_header(
+    FILE          *res,
+    const char    *out_dir,
+    const size_t   nof_runs,
+    const param_t *params,
+    const size_t   nof_params
+) {
+    char line[4096];
+    stats_header(out_dir, nof_runs, line, sizeof(line));
+
+    fprintf(res, "Run");
+    it(i, 0, nof_params) fprintf(res, ",%s", params[i].key);
+    fprintf(
+        res, ",Rep,Seed,Outcome,Wall_ms%s%s", line[0] == '\n' ? "" : ",", line
+    );
+}
+
+/**
+ * @brief Appends the per-day rows of a run to the results table.
+ * * Every row carries the run number, the swept values and the outcome read
+ * from summary.json; a run that left no stats still gets one row.
+ */
+static void
+merge_run(
+    FILE          *res,
+    const char    *dir,
+    const size_t   run,
+    const param_t *params,
+    const size_t   nof_params,
+    const run_t   *info
+) {
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/summary.json", dir);
+    cJSON       *summary = read_json(path);
+    const cJSON *outcome = cJSON_GetObjectItemCaseSensitive(summary, "outcome");
+    const cJSON *wall    = cJSON_GetObjectItemCaseSensitive(summary, "wall_ms");
+
+    char prefix[1024];
+    int  len = snprintf(prefix, sizeof(prefix), "%zu", run);
+    it(i, 0, nof_params) len += snprintf(
+        prefix + len, sizeof(prefix) - len, ",%s",
+        params[i].values[info->combo[i]]
+    );
+    snprintf(
+        prefix + len, sizeof(prefix) - len, ",%zu,%u,%s,%ld", info->rep,
+        info->seed,
+        cJSON_IsString(outcome) ? outcome->valuestring : "failed",
+        cJSON_IsNumber(wall) ? (long)wall->valuedouble : -1L
+    );
+    cJSON_Delete(summary);
+
+    snprintf(path, sizeof(path), "%s/stats.csv", dir);
+    FILE *csv  = fopen(path, "r");
+    char  line[4096];
+    bool  rows = false;
+
+    /* Skip the header of stats.csv */
+    if (csv && fgets(line, sizeof(line), csv)) {
+        while (fgets(line, sizeof(line), csv)) {
+            fprintf(res, "%s,%s", prefix, line);
+            rows = true;
+        }
+    }
+    if (csv)
+        fclose(csv);
+
+    if (!rows)
+        fprintf(res, "%s\n", prefix);
+}
+
+/**
+ * @brief Adds one value to a running mean and variance.
+ */
+static inline void
+acc_add(acc_t *acc, const double x) {
+    const double delta = x - acc->mean;
+    acc->n++;
+    acc->mean += delta / (double)acc->n;
+    acc->m2 += delta * (x - acc->mean);
+}
+
+/**
+ * @brief 97.5th percentile of Student's t with df degrees of freedom.
+ * * Past the table, the first term of the expansion around the normal.
+ */
+static inline double
+t975(const size_t df) {
+    if (df <= sizeof(T975) / sizeof(T975[0]))
+        return T975[df - 1];
+    return 1.96 + 2.37 / (double)df;
+}
+
+/**
+ * @brief Writes replications.csv: the statistics of every stats.csv column,
+ * per combination and day, over the replications of that combination.
+ * * A replication that stopped early only counts for the days it finished,
+ * N says how many did.
+ */
+static void
+merge_replications(
+    const char    *out_dir,
+    const run_t   *runs,
+    const size_t   nof_runs,
+    const size_t   reps,
+    const param_t *params,
+    const size_t   nof_params
+) {
+    char header[4096];
+    stats_header(out_dir, nof_runs, header, sizeof(header));
+    if (header[0] == '\n')
+        return;
+
+    /* Column names, the first one is the day */
+    char  *names[SWEEP_MAX_COLUMNS];
+    size_t nof_cols = 0;
+    header[strcspn(header, "\r\n")] = '\0';
+    for (char *tok = strtok(header, ","); tok; tok = strtok(NULL, ",")) {
+        if (nof_cols == SWEEP_MAX_COLUMNS)
+            panic(
+                "ERROR: More than %d columns in stats.csv\n", SWEEP_MAX_COLUMNS
+            );
+        names[nof_cols++] = tok;
+    }
+
+    char report[PATH_MAX], path[PATH_MAX];
+    snprintf(report, sizeof(report), "%s/replications.csv", out_dir);
+    FILE *out = zfopen(report, "w");
+    it(i, 0, nof_params) fprintf(out, "%s,", params[i].key);
+    fprintf(out, "Day,Metric,N,Mean,SD,CI95_Low,CI95_High\n");
+
+    for (size_t c = 0; c < nof_runs; c += reps) {
+        acc_t *acc      = NULL;
+        size_t nof_days = 0;
+
+        it(k, 0, reps) {
+            if (c + (size_t)k >= nof_runs)
+                break;
+            snprintf(
+                path, sizeof(path), "%s/run_%04zu/stats.csv", out_dir,
+                c + (size_t)k
+            );
+            FILE *csv = fopen(path, "r");
+            char  line[4096];
+
+            /* Skip the header of stats.csv */
+            if (csv == NULL || !fgets(line, sizeof(line), csv)) {
+                if (csv)
+                    fclose(csv);
+                continue;
+            }
+            while (fgets(line, sizeof(line), csv)) {
+                char        *field = line;
+                const size_t day   = strtoul(field, &field, 10);
+                if (day == 0)
+                    continue;
+
+                if (day > nof_days) {
+                    acc = zrealloc(acc, day * nof_cols * sizeof(acc_t));
+                    memset(
+                        acc + nof_days * nof_cols, 0,
+                        (day - nof_days) * nof_cols * sizeof(acc_t)
+                    );
+                    nof_days = day;
+                }
+                it(j, 1, nof_cols) {
+                    if (*field != ',')
+                        break;
+                    const double x = strtod(field + 1, &field);
+                    acc_add(&acc[(day - 1) * nof_cols + j], x);
+                }
+            }
+            fclose(csv);
+        }
+
+        it(d, 0, nof_days) it(j, 1, nof_cols) {
+            const acc_t *a = &acc[d * nof_cols + j];
+            if (a->n == 0)
+                continue;
+
+            const double sd   = a->n > 1 ? sqrt(a->m2 / (double)(a->n - 1)) : 0;
+            const double half =
+                a->n > 1 ? t975(a->n - 1) * sd / sqrt((double)a->n) : 0;
+
+            it(i, 0, nof_params)
+                fprintf(out, "%s,", params[i].values[runs[c].combo[i]]);
+            fprintf(
+                out, "%d,%s,%zu,%.4f,%.4f,%.4f,%.4f\n", d + 1, names[j], a->n,
+                a->mean, sd, a->mean - half, a->mean + half
+            );
+        }
+        free(acc);
+    }
+    fclose(out);
+
+    printf(
+        "[SWEEP] Mean, SD and 95%% CI over %zu replications in %s\n", reps,
+        report
+    );
+}
+
+int
+main(int argc, char **argv) {
+    const char *out_dir = SWEEP_OUT_DEFAULT;
+    long        jobs    = sysconf(_SC_NPROCESSORS_ONLN);
+    long        reps    = 1;
+    uint32_t    seed    = (uint32_t)time(NULL);
+    int         opt;
+
+    while ((opt = getopt(argc, argv, "j:r:s:o:")) != -1) {
+        switch (opt) {
+        case 'j':
+            jobs = atol(optarg);
+            break;
+        case 'r':
+            reps = atol(optarg);
+            break;
+        case 's': {
+            char *end;
+            errno                     = 0;
+            const unsigned long value = strtoul(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || errno != 0 ||
+                value > UINT32_MAX) {
+                fprintf(stderr, "ERROR: Bad seed `%s`.\n", optarg);
+                usage(argv[0]);
+            }
+            seed = (uint32_t)value;
+            break;
+        }
+        case 'o':
+            out_dir = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind >= argc || jobs <= 0 || reps <= 0)
+        usage(argv[0]);
+
+    cJSON *base = read_json(argv[optind]);
+    if (base == NULL)
+        panic("ERROR: Unable to read the config %s\n", argv[optind]);
+
+    param_t params[SWEEP_MAX_PARAMS];
+    size_t  nof_params = 0;
+    size_t  nof_runs   = 1;
+    for (int i = optind + 1; i < argc; i++) {
+        if (nof_params == SWEEP_MAX_PARAMS)
+            panic("ERROR: At most %d swept keys\n", SWEEP_MAX_PARAMS);
+        parse_param(argv[i], &params[nof_params]);
+        if (!cJSON_GetObjectItemCaseSensitive(base, params[nof_params].key))
+            fprintf(
+                stderr, "[SWEEP] %s is not in the base config, adding it\n",
+                params[nof_params].key
+            );
+        nof_runs *= params[nof_params].nof_values;
+        nof_params++;
+    }
+
+    if (mkdir(out_dir, 0755) == -1 && errno != EEXIST)
+        panic("ERROR: Unable to create %s\n", out_dir);
+
+    /* Cartesian product, the last key changes fastest, then the replications
+     * of each combination next to each other */
+    nof_runs *= (size_t)reps;
+    run_t *runs = zcalloc(nof_runs, sizeof(run_t));
+    it(r, 0, nof_runs) {
+        size_t rest  = (size_t)r / (size_t)reps;
+        runs[r].rep  = (size_t)r % (size_t)reps;
+        runs[r].seed = seed + (uint32_t)runs[r].rep;
+        it(i, nof_params - 1, -1) {
+            runs[r].combo[i] = rest % params[i].nof_values;
+            rest /= params[i].nof_values;
+        }
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handler_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = handler_kill;
+    sigaction(SIGALRM, &sa, NULL);
+
+    printf(
+        "[SWEEP] %zu runs, %ld at a time, seeds from %u, results in %s\n",
+        nof_runs, jobs, seed, out_dir
+    );
+    fflush(stdout);
+
+    char   dir[PATH_MAX];
+    size_t next = 0, running = 0, done = 0;
+    bool   term_sent = false, kill_sent = false;
+    while (next < nof_runs || running > 0) {
+        while (!g_stop && next < nof_runs && running < (size_t)jobs) {
+            snprintf(dir, sizeof(dir), "%s/run_%04zu", out_dir, next);
+            runs[next].pid = launch(
+                base, params, nof_params, runs[next].combo, runs[next].seed,
+                dir
+            );
+            next++;
+            running++;
+        }
+        if (g_stop && running > 0 && !term_sent) {
+            /* Stop the batch: every run ends as interrupted */
+            it(r, 0, next) if (runs[r].pid > 0) kill(runs[r].pid, SIGTERM);
+            term_sent = true;
+            alarm(SWEEP_KILL_AFTER_S);
+        }
+        if (g_kill && running > 0 && !kill_sent) {
+            /* Runs still closing after the grace period: kill them */
+            it(r, 0, next) if (runs[r].pid > 0) kill(-runs[r].pid, SIGKILL);
+            kill_sent = true;
+        }
+        if (running == 0)
+            break;
+
+        int         status;
+        const pid_t pid = wait(&status);
+        if (pid == -1)
+            continue; // EINTR, g_stop and g_kill are checked above
+
+        it(r, 0, next) {
+            if (runs[r].pid != pid)
+                continue;
+            runs[r].pid    = 0;
+            runs[r].status = status;
+            running--;
+            done++;
+            printf(
+                "[SWEEP] run %04d finished (%zu/%zu), exit code %d\n", r, done,
+                nof_runs, WIFEXITED(status) ? WEXITSTATUS(status) : -1
+            );
+            fflush(stdout);
+        }
+    }
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/results.csv", out_dir);
+    FILE *res = zfopen(path, "w");
+    merge_header(res, out_dir, next, params, nof_params);
+    it(r, 0, next) {
+        snprintf(dir, sizeof(dir), "%s/run_%04d", out_dir, r);
+        merge_run(res, dir, r, params, nof_params, &runs[r]);
+    }
+    fclose(res);
+
+    printf("[SWEEP] %zu/%zu runs merged into %s\n", next, nof_runs, path);
+    if (reps > 1)
+        merge_replications(
+            out_dir, runs, next, (size_t)reps, params, nof_params
+        );
+
+    it(i, 0, nof_params) it(v, 0, params[i].nof_values) free(params[i].values[v]);
+    free(runs);
+    cJSON_Delete(base);
+    return g_stop ? 1 : 0;
+}
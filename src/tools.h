@@ -2,14 +2,21 @@
 #define _TOOLS_H
 
 #include <errno.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <string.h>
 #include <sys/msg.h>
 #include <sys/sem.h>
 #include <sys/shm.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <termios.h>
 #include <time.h>
 #include <unistd.h>
@@ -22,8 +29,40 @@
  * ========================================================================= */
 
 #define SHM_RW 0666
+
+/* Run directory: rendezvous files, log and stats of one simulation */
+#define RUN_DIR_ENV "SIM_RUN_DIR"
+#define RUN_DIR_DEFAULT "data"
 #define DEBUG 0
 
+/* rand() streams of the processes, see stream_seed; main is stream 0 */
+#define SEED_WORKER (1u << 30)
+#define SEED_CLIENT (2u << 30)
+#define SEED_ELASTIC (3u << 30)
+
+/* Day drain: how often the coordinator checks on the children, and how long
+ * it waits for one of them to leave before closing the day anyway */
+#define DAY_DRAIN_TICK_MS 100
+#define DAY_DRAIN_TIMEOUT_S 30
+
+/* Shared memory segments of a simulation, all of which a process may attach:
+ * ctx, stations, menu, trace and the workers of each station */
+enum {
+    SHM_SEG_CTX,
+    SHM_SEG_STATIONS,
+    SHM_SEG_MENU,
+    SHM_SEG_TRACE,
+    SHM_SEG_WORKERS,
+    SHM_SEGMENTS = SHM_SEG_WORKERS + NOF_STATIONS
+};
+
+/* Room for every segment, plus some for the ones still to come */
+#define SHM_CACHE_MAX (2 * SHM_SEGMENTS)
+_Static_assert(
+    SHM_CACHE_MAX >= SHM_SEGMENTS,
+    "the shm cache must hold every segment of the simulation"
+);
+
 /**
  * Generic pointer type for better readability.
  */
@@ -55,44 +94,109 @@ static inline any zrealloc(any old_ptr, size_t size);
 static inline any zcalloc(size_t new_size, size_t size);
 
 /* Process Management */
-static inline pid_t zfork();
+static inline pid_t    zfork();
+static inline unsigned stream_seed(const uint32_t seed, const uint32_t stream);
 
 /* Semaphore IPC */
-static inline sem_t sem_init(const int val);
-static inline int   sem_wait(const sem_t sem_id);
-static inline int   sem_signal(const sem_t sem_id);
-static inline void  sem_set(const sem_t id, const int val);
-static inline int   sem_wait_zero(const sem_t id);
-static inline int   sem_getval(const sem_t id);
-static inline int   sem_kill(sem_t sem);
+static inline void  sem_pool_init(sem_pool_t *pool);
+static inline void  sem_pool_commit(sem_pool_t *pool);
+static inline int   sem_pool_kill(sem_pool_t *pool);
+static inline sem_t sem_init(sem_pool_t *pool, const int val);
+static inline int   sem_wait(const sem_t sem);
+static inline int   sem_signal(const sem_t sem);
+static inline void  sem_set(const sem_t sem, const int val);
+static inline int   sem_wait_zero(const sem_t sem);
+static inline int   sem_wait_zero_all(const sem_t *sems, const size_t n);
+static inline int   sem_getval(const sem_t sem);
+
+/* Group Barrier */
+static inline int      zfutex_wait(
+    uint32_t *word, const uint32_t val, const struct timespec *timeout
+);
+static inline void     zfutex_wake_all(uint32_t *word);
+static inline uint32_t group_arrive(struct groups_t *group, bool *last);
+static inline void     group_release(struct groups_t *group);
+static inline int      group_wait(
+    const simctx_t *ctx, struct groups_t *group, const uint32_t gen
+);
+static inline void     group_cancel_all(simctx_t *ctx);
+static inline void     group_admit(simctx_t *ctx, struct groups_t *group);
+static inline bool     group_arrival_wait(struct groups_t *group);
+
+/* Day Barrier */
+static inline void     day_open(
+    simctx_t *ctx, const uint32_t workers, const uint32_t users_in
+);
+static inline void     day_join(simctx_t *ctx, const uint32_t users);
+static inline void     day_close(simctx_t *ctx);
+static inline uint32_t day_drain(simctx_t *ctx, void (*idle)(simctx_t *ctx));
+static inline void     day_release_all(simctx_t *ctx);
+static inline uint32_t day_wait(simctx_t *ctx, const uint32_t seen);
+static inline void     day_leave(simctx_t *ctx, const bool user);
+static inline void     day_sleep(const simctx_t *ctx, const size_t wait_time);
+
+/* Metrics Snapshot */
+static inline void snap_publish(simctx_t *ctx, const snapshot_t *snap);
+static inline bool snap_read(const simctx_t *ctx, snapshot_t *snap);
 
 /* Shared Memory IPC */
 static inline size_t    zshmget(size_t size);
 static inline any       zshmat(size_t shmid);
+static inline void      zshmdt(size_t shmid);
+static inline size_t    zshm_attached(void);
 static inline int       shm_kill(shmid_t id);
 static inline simctx_t *get_ctx(size_t shmid);
 static inline station  *get_stations(size_t shmid);
 static inline worker_t *get_workers(size_t shmid);
+static inline menu_t   *get_menu(size_t shmid);
+
+/* Dish Catalog */
+static inline dish_slot_t *menu_slot(menu_t *menu, dish_type type, size_t i);
+static inline dish_slot_t *menu_find(menu_t *menu, dish_type type, size_t id);
+static inline size_t       menu_leftovers(menu_t *menu, dish_type type);
 
 /* Message Queue IPC */
 static inline size_t zmsgget(const key_t key, const int mode);
+static inline size_t zmsgqnum(const size_t qid);
+static inline size_t station_backlog(const simctx_t *ctx, const station *st);
+static inline int    station_active(const simctx_t *ctx, const station *st);
 static inline int    msg_kill(int id);
 
 /* File Operations */
+static inline const char *run_path(const char *name);
 static inline FILE *zfopen(const char *fname, const char *mode);
 static inline void  zfscanf(FILE *file, const char *fmt, ...);
 static inline long  zfsize(FILE *file);
 static void         fclear(const char *filename);
-static inline void
-save_stats_csv(const simctx_t *ctx, const station *stations, const size_t day);
+static inline void save_stats_csv(
+    const simctx_t *ctx,
+    const station  *stations,
+    menu_t         *menu,
+    const size_t    day,
+    const size_t   *roster
+);
 
 /* General Utilities */
 static void          zprintf(const sem_t sem_id, const char *fmt, ...);
 static inline void   znsleep(const size_t wait_time);
+static inline uint32_t zstamp(void);
+static inline size_t   zminutes_since(const uint32_t since);
+static inline size_t hist_bucket(const size_t minutes);
+static inline size_t hist_floor(const size_t bucket);
+static inline void   hist_add(size_t *hist, const size_t minutes);
+static inline size_t hist_percentile(const size_t *hist, const double p);
+static inline size_t class_percentile(
+    size_t hist[REQ_CLASSES][WAIT_BUCKETS], const size_t cls, const double p
+);
+static inline double class_mean(size_t hist[REQ_CLASSES][WAIT_BUCKETS]);
+static inline size_t wk_slots(const conf_t *conf);
+static inline size_t break_slot(const conf_t *conf, const size_t taken);
 static inline size_t atos(const char *str);
 static inline bool   atob(const char *str);
 static inline char  *itos(const int val);
 static inline size_t get_service_time(size_t avg_time, size_t percent);
+static inline size_t
+service_time_at(size_t avg_time, size_t percent, const unsigned draw);
 static inline void   handle_signal(int sig);
 
 /* =========================================================================
@@ -167,45 +271,89 @@ zfork() {
     return pid;
 }
 
+/**
+ * Seed of the rand() stream of one process, from the seed of the run.
+ * The two are mixed with a splitmix64 step, so every process draws its own
+ * numbers and the same run seed gives back the same streams.
+ */
+static inline unsigned
+stream_seed(const uint32_t seed, const uint32_t stream) {
+    uint64_t z = ((uint64_t)seed << 32 | stream) + 0x9E3779B97F4A7C15ull;
+    z          = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z          = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return (unsigned)(z ^ (z >> 31));
+}
+
 /* =========================================================================
  * Implementation: Semaphore IPC
  * ========================================================================= */
 
 /**
- * Initialize a private semaphore with a specific value.
+ * Create the semaphore set the pool hands out indexes from.
  */
-static inline sem_t
-sem_init(const int val) {
-    int sem_id = semget(IPC_PRIVATE, 1, IPC_CREAT | 0666);
+static inline void
+sem_pool_init(sem_pool_t *pool) {
+    pool->set  = semget(IPC_PRIVATE, SEM_POOL_SIZE, IPC_CREAT | 0666);
+    pool->used = 0;
 
-    if (sem_id == -1)
-        panic("ERROR: Semaphore init failed\n");
+    if (pool->set == -1)
+        panic("ERROR: Semaphore pool init failed\n");
+}
 
+/**
+ * Write every initial value with a single SETALL, after the last sem_init.
+ */
+static inline void
+sem_pool_commit(sem_pool_t *pool) {
     union _semun arg;
-    arg.val = val;
+    arg.array = pool->val;
 
-    if (semctl(sem_id, 0, SETVAL, arg) == -1)
-        panic("ERROR: Semaphore init failed\n");
+    if (semctl(pool->set, 0, SETALL, arg) == -1)
+        panic("ERROR: Semaphore pool commit failed\n");
+}
 
-    return sem_id;
+/**
+ * Remove the whole set, and with it every semaphore of the pool.
+ */
+static inline int
+sem_pool_kill(sem_pool_t *pool) {
+    return semctl(pool->set, 0, IPC_RMID);
+}
+
+/**
+ * Take the next semaphore of the pool. The value is only written to the
+ * kernel by sem_pool_commit.
+ */
+static inline sem_t
+sem_init(sem_pool_t *pool, const int val) {
+    if (pool->used == SEM_POOL_SIZE)
+        panic("ERROR: Semaphore pool exhausted\n");
+
+    pool->val[pool->used] = (unsigned short)val;
+    return (sem_t){.set = pool->set, .idx = pool->used++};
 }
 
 /**
  * Perform a P operation (Wait).
  * Returns -1 if interrupted or the semaphore is removed.
+ * Both operations use SEM_UNDO, so a process exiting between the two gives
+ * the semaphore back and one that exits after both leaves it unchanged.
  */
 static inline int
-sem_wait(const sem_t sem_id) {
+sem_wait(const sem_t sem) {
     struct sembuf sb;
-    sb.sem_num = 0;
+    sb.sem_num = sem.idx;
     sb.sem_op  = -1;
     sb.sem_flg = SEM_UNDO;
 
-    if (semop(sem_id, &sb, 1) == -1) {
+    if (semop(sem.set, &sb, 1) == -1) {
         if (errno == EINTR || errno == EIDRM || errno == EINVAL) {
             return -1;
         }
-        panic("ERROR: sem_wait failed, id %d, errno %d\n", sem_id, errno);
+        panic(
+            "ERROR: sem_wait failed, set %d idx %d, errno %d\n", sem.set,
+            sem.idx, errno
+        );
     }
     return 0;
 }
@@ -214,17 +362,17 @@ sem_wait(const sem_t sem_id) {
  * Perform a V operation (Signal/Increment).
  */
 static inline int
-sem_signal(const sem_t sem_id) {
+sem_signal(const sem_t sem) {
     struct sembuf sb;
-    sb.sem_num = 0;
+    sb.sem_num = sem.idx;
     sb.sem_op  = 1;
-    sb.sem_flg = 0;
+    sb.sem_flg = SEM_UNDO;
 
-    if (semop(sem_id, &sb, 1) == -1) {
+    if (semop(sem.set, &sb, 1) == -1) {
         if (errno == EINTR || errno == EIDRM || errno == EINVAL) {
             return -1;
         }
-        panic("ERROR: sem_signal failed, id %d\n", sem_id);
+        panic("ERROR: sem_signal failed, set %d idx %d\n", sem.set, sem.idx);
     }
 
     return 0;
@@ -234,11 +382,11 @@ sem_signal(const sem_t sem_id) {
  * Explicitly set the value of a semaphore.
  */
 static inline void
-sem_set(const sem_t id, const int val) {
+sem_set(const sem_t sem, const int val) {
     union _semun arg;
     arg.val = val;
 
-    if (semctl(id, 0, SETVAL, arg) == -1)
+    if (semctl(sem.set, sem.idx, SETVAL, arg) == -1)
         panic("ERROR: set_sem failed\n");
 }
 
@@ -246,13 +394,27 @@ sem_set(const sem_t id, const int val) {
  * Block the process until the semaphore value reaches zero.
  */
 static inline int
-sem_wait_zero(const sem_t id) {
-    struct sembuf sem_b;
-    sem_b.sem_num = 0;
-    sem_b.sem_op  = 0;
-    sem_b.sem_flg = 0;
+sem_wait_zero(const sem_t sem) {
+    return sem_wait_zero_all(&sem, 1);
+}
 
-    if (semop(id, &sem_b, 1) == -1) {
+/**
+ * Block the process until all the semaphores are zero at the same time,
+ * with a single semop. They must come from the same pool.
+ */
+static inline int
+sem_wait_zero_all(const sem_t *sems, const size_t n) {
+    struct sembuf sb[SEM_POOL_SIZE];
+
+    it(i, 0, n) {
+        if (sems[i].set != sems[0].set)
+            panic("ERROR: sem_wait_zero_all across different sets\n");
+        sb[i].sem_num = sems[i].idx;
+        sb[i].sem_op  = 0;
+        sb[i].sem_flg = 0;
+    }
+
+    if (semop(sems[0].set, sb, n) == -1) {
         if (errno == EINTR || errno == EIDRM || errno == EINVAL) {
             return -1;
         }
@@ -266,20 +428,329 @@ sem_wait_zero(const sem_t id) {
  * Get the current value of the semaphore.
  */
 static inline int
-sem_getval(const sem_t id) {
-    const int val = semctl(id, 0, GETVAL);
-    if (val == -1)
+sem_getval(const sem_t sem) {
+    const int val = semctl(sem.set, sem.idx, GETVAL);
+    if (val == -1) {
+        /* The day's set is gone, nobody holds its semaphores anymore */
+        if (errno == EIDRM || errno == EINVAL)
+            return 0;
         panic("ERROR: semctl GETVAL failed\n");
+    }
 
     return val;
 }
 
+/* =========================================================================
+ * Implementation: Group Barrier
+ * Generation counting barrier living in ctx->groups[]: members_ready counts
+ * the arrivals, generation is the futex word the others sleep on.
+ * ========================================================================= */
+
+/**
+ * Sleep while *word still holds val, at most for timeout (NULL = forever).
+ * The word is in shared memory, so the futex is not process private.
+ * Returns -1 if interrupted by a signal.
+ */
+static inline int
+zfutex_wait(uint32_t *word, const uint32_t val, const struct timespec *timeout) {
+    if (syscall(SYS_futex, word, FUTEX_WAIT, val, timeout, NULL, 0) == -1) {
+        if (errno == EINTR)
+            return -1;
+        if (errno != EAGAIN && errno != ETIMEDOUT)
+            panic("ERROR: futex wait failed, errno %d\n", errno);
+    }
+    return 0;
+}
+
+/**
+ * Wake every process sleeping on the futex word.
+ */
+static inline void
+zfutex_wake_all(uint32_t *word) {
+    if (syscall(SYS_futex, word, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0) == -1)
+        panic("ERROR: futex wake failed, errno %d\n", errno);
+}
+
+/**
+ * Register the arrival of a member.
+ * Returns the generation to wait on; *last is set for the member completing
+ * the group, which must call group_release.
+ */
+static inline uint32_t
+group_arrive(struct groups_t *group, bool *last) {
+    const uint32_t gen = __atomic_load_n(&group->generation, __ATOMIC_ACQUIRE);
+    const uint32_t ready =
+        __atomic_add_fetch(&group->members_ready, 1, __ATOMIC_ACQ_REL);
+
+    *last = ready == group->total_members;
+    return gen;
+}
+
 /**
- * Remove the semaphore from the system.
+ * Reopen the barrier and release the whole group with a single wake.
+ */
+static inline void
+group_release(struct groups_t *group) {
+    __atomic_store_n(&group->members_ready, 0, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&group->generation, 1, __ATOMIC_RELEASE);
+    zfutex_wake_all(&group->generation);
+}
+
+/**
+ * Block until the generation moves past gen or the day is over.
+ * Returns -1 with errno EINTR if interrupted by a signal, ECANCELED if the
+ * day ended.
  */
 static inline int
-sem_kill(sem_t sem) {
-    return semctl(sem, 0, IPC_RMID);
+group_wait(const simctx_t *ctx, struct groups_t *group, const uint32_t gen) {
+    while (__atomic_load_n(&group->generation, __ATOMIC_ACQUIRE) == gen) {
+        if (!__atomic_load_n(&ctx->is_day_running, __ATOMIC_ACQUIRE)) {
+            errno = ECANCELED;
+            return -1;
+        }
+        if (zfutex_wait(&group->generation, gen, NULL) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * Release every group still waiting for someone, at the end of the day, and
+ * send home the groups that never arrived.
+ * Must be called after is_day_running is cleared: a member arriving later
+ * sees the flag and does not sleep.
+ */
+static inline void
+group_cancel_all(simctx_t *ctx) {
+    it(i, 0, ctx->config.nof_users) {
+        struct groups_t *group = &ctx->groups[i];
+
+        if (__atomic_load_n(&group->members_ready, __ATOMIC_ACQUIRE))
+            group_release(group);
+        if (__atomic_load_n(&group->arrival, __ATOMIC_ACQUIRE) == ARRIVAL_WAIT) {
+            __atomic_store_n(&group->arrival, ARRIVAL_CANCELLED, __ATOMIC_RELEASE);
+            zfutex_wake_all(&group->arrival);
+        }
+    }
+}
+
+/**
+ * Let a group into the running day, called by the coordinator only.
+ * Its members count as users in the day from now on.
+ */
+static inline void
+group_admit(simctx_t *ctx, struct groups_t *group) {
+    __atomic_add_fetch(
+        &ctx->day.users_in, (uint32_t)group->total_members, __ATOMIC_RELAXED
+    );
+    __atomic_store_n(&group->arrival, ARRIVAL_IN, __ATOMIC_RELEASE);
+    zfutex_wake_all(&group->arrival);
+}
+
+/**
+ * Block a member until its group is admitted.
+ * Returns false if the day ended first: the member leaves the day without
+ * having been a user of it.
+ */
+static inline bool
+group_arrival_wait(struct groups_t *group) {
+    uint32_t state;
+    while ((state = __atomic_load_n(&group->arrival, __ATOMIC_ACQUIRE)) ==
+           ARRIVAL_WAIT)
+        zfutex_wait(&group->arrival, ARRIVAL_WAIT, NULL);
+
+    return state == ARRIVAL_IN;
+}
+
+/* =========================================================================
+ * Implementation: Day Barrier
+ * Workers and clients park on ctx->day.epoch between two days, the
+ * coordinator opens a day with a single wake and waits for day.pending to
+ * drop to zero after closing it. Closing is a flag: day.open wakes whoever
+ * sleeps in day_sleep, the blocking IPC calls are released by removing the
+ * day's queues and semaphores (see close_day_ipc in main.c).
+ * ========================================================================= */
+
+/**
+ * Start a day for the roster workers and every user, then wake them all.
+ * users_in are the users already admitted, the others arrive later through
+ * group_admit or never.
+ */
+static inline void
+day_open(simctx_t *ctx, const uint32_t workers, const uint32_t users_in) {
+    const uint32_t users = (uint32_t)ctx->config.nof_users;
+
+    __atomic_store_n(&ctx->day.users_in, users_in, __ATOMIC_RELAXED);
+    __atomic_store_n(
+        &ctx->day.pending, workers + users - ctx->day.gone, __ATOMIC_RELAXED
+    );
+    __atomic_store_n(&ctx->day.open, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&ctx->is_day_running, true, __ATOMIC_RELAXED);
+
+    __atomic_add_fetch(&ctx->day.epoch, 1, __ATOMIC_RELEASE);
+    zfutex_wake_all(&ctx->day.epoch);
+}
+
+/**
+ * Count users spawned while the day is running, they join it at once.
+ */
+static inline void
+day_join(simctx_t *ctx, const uint32_t users) {
+    __atomic_add_fetch(&ctx->day.users_in, users, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&ctx->day.pending, users, __ATOMIC_RELEASE);
+}
+
+/**
+ * End the day: clear the flags and cut short every day_sleep.
+ */
+static inline void
+day_close(simctx_t *ctx) {
+    __atomic_store_n(&ctx->is_day_running, false, __ATOMIC_RELEASE);
+    __atomic_store_n(&ctx->day.open, 0, __ATOMIC_RELEASE);
+    zfutex_wake_all(&ctx->day.open);
+}
+
+/**
+ * Block the coordinator until every worker and user has left the day.
+ * The wait is bounded: every DAY_DRAIN_TICK_MS the children that died
+ * without leaving are reaped and taken off day.pending (and off the next
+ * days, through day.gone), and when nobody
+ * leaves for DAY_DRAIN_TIMEOUT_S the day is closed anyway.
+ * idle, if not NULL, runs at every tick the coordinator spends waiting.
+ * Returns the processes that never left, dead or stuck.
+ */
+static inline uint32_t
+day_drain(simctx_t *ctx, void (*idle)(simctx_t *ctx)) {
+    const struct timespec tick = {0, DAY_DRAIN_TICK_MS * 1000000L};
+    uint32_t              lost = 0;
+    uint32_t              left, seen = UINT32_MAX;
+    struct timespec       since = {0}, now;
+
+    while ((left = __atomic_load_n(&ctx->day.pending, __ATOMIC_ACQUIRE)) > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (left != seen) {
+            seen  = left;
+            since = now;
+        } else if (now.tv_sec - since.tv_sec >= DAY_DRAIN_TIMEOUT_S) {
+            __atomic_store_n(&ctx->day.pending, 0, __ATOMIC_RELEASE);
+            lost += left;
+            break;
+        }
+
+        zfutex_wait(&ctx->day.pending, left, &tick);
+        if (idle)
+            idle(ctx);
+
+        /* A child that died in the day never calls day_leave */
+        while (waitpid(-1, NULL, WNOHANG) > 0) {
+            uint32_t n = __atomic_load_n(&ctx->day.pending, __ATOMIC_ACQUIRE);
+            while (n > 0 && !__atomic_compare_exchange_n(
+                                &ctx->day.pending, &n, n - 1, false,
+                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE
+                            ))
+                ;
+            lost += n > 0;
+            ctx->day.gone++;
+        }
+    }
+    return lost;
+}
+
+/**
+ * Wake everyone parked between two days without opening one, at shutdown.
+ */
+static inline void
+day_release_all(simctx_t *ctx) {
+    __atomic_add_fetch(&ctx->day.epoch, 1, __ATOMIC_RELEASE);
+    zfutex_wake_all(&ctx->day.epoch);
+}
+
+/**
+ * Park until a day newer than seen is opened.
+ * Returns the epoch of that day, to pass on the next call.
+ */
+static inline uint32_t
+day_wait(simctx_t *ctx, const uint32_t seen) {
+    uint32_t epoch;
+    while ((epoch = __atomic_load_n(&ctx->day.epoch, __ATOMIC_ACQUIRE)) == seen)
+        zfutex_wait(&ctx->day.epoch, seen, NULL);
+
+    return epoch;
+}
+
+/**
+ * Leave the day; the last one out wakes the coordinator.
+ */
+static inline void
+day_leave(simctx_t *ctx, const bool user) {
+    if (user)
+        __atomic_sub_fetch(&ctx->day.users_in, 1, __ATOMIC_RELAXED);
+
+    if (__atomic_sub_fetch(&ctx->day.pending, 1, __ATOMIC_ACQ_REL) == 0)
+        zfutex_wake_all(&ctx->day.pending);
+}
+
+/**
+ * Like znsleep, but returns as soon as the day is closed.
+ */
+static inline void
+day_sleep(const simctx_t *ctx, const size_t wait_time) {
+    const size_t    total_ns = wait_time * N_NANO_SECS;
+    struct timespec req;
+
+    req.tv_sec  = (time_t)(total_ns / TO_NANOSEC);
+    req.tv_nsec = (long)(total_ns % TO_NANOSEC);
+
+    zfutex_wait((uint32_t *)&ctx->day.open, 1, &req);
+}
+
+/* =========================================================================
+ * Implementation: Metrics Snapshot
+ * Seqlock over ctx->snap: the coordinator is the only writer and makes the
+ * sequence odd while it copies, readers retry when they saw an odd value or
+ * the sequence moved under them. Readers never block the writer.
+ * ========================================================================= */
+
+/* Attempts before snap_read gives up, the caller keeps its last copy */
+#define SNAP_READ_TRIES 64
+
+/**
+ * Publish a new snapshot, called by the coordinator only.
+ */
+static inline void
+snap_publish(simctx_t *ctx, const snapshot_t *snap) {
+    const uint32_t seq = __atomic_load_n(&ctx->snap.seq, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&ctx->snap.seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&ctx->snap.data, snap, sizeof(*snap));
+    __atomic_store_n(&ctx->snap.seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * Copy a consistent snapshot into *snap.
+ * Returns false, leaving *snap untouched, if every attempt raced with the
+ * writer.
+ */
+static inline bool
+snap_read(const simctx_t *ctx, snapshot_t *snap) {
+    snapshot_t copy;
+
+    it(i, 0, SNAP_READ_TRIES) {
+        const uint32_t seq = __atomic_load_n(&ctx->snap.seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            sched_yield();
+            continue;
+        }
+
+        memcpy(&copy, (const void *)&ctx->snap.data, sizeof(copy));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&ctx->snap.seq, __ATOMIC_RELAXED) == seq) {
+            *snap = copy;
+            return true;
+        }
+    }
+    return false;
 }
 
 /* =========================================================================
@@ -297,18 +768,67 @@ zshmget(size_t size) {
     return (size_t)res;
 }
 
+/**
+ * Segments attached by this process, each one mapped only once.
+ */
+static struct {
+    size_t id;
+    any    addr;
+} g_shm_cache[SHM_CACHE_MAX];
+static size_t g_shm_cached = 0;
+
 /**
  * Attach the shared memory segment to the process address space.
+ * Repeated calls return the mapping made by the first one, so callers never
+ * detach: the segment stays mapped until zshmdt.
  */
 static inline any
 zshmat(size_t shmid) {
+    it(i, 0, g_shm_cached) {
+        if (g_shm_cache[i].id == shmid)
+            return g_shm_cache[i].addr;
+    }
+
+    if (g_shm_cached == SHM_CACHE_MAX)
+        panic(
+            "ERROR: Too many shared memory segments attached (%d), update "
+            "SHM_SEGMENTS\n", SHM_CACHE_MAX
+        );
+
     /* The kernel chooses the address (NULL), default R/W flags (0) */
     any res = shmat((int)shmid, NULL, 0);
     if (res == (void *)-1)
         panic("ERROR: Shared memory `at` is failed\n");
+
+    g_shm_cache[g_shm_cached].id   = shmid;
+    g_shm_cache[g_shm_cached].addr = res;
+    g_shm_cached++;
     return res;
 }
 
+/**
+ * Detach a segment and drop it from the cache.
+ */
+static inline void
+zshmdt(size_t shmid) {
+    it(i, 0, g_shm_cached) {
+        if (g_shm_cache[i].id != shmid)
+            continue;
+
+        shmdt(g_shm_cache[i].addr);
+        g_shm_cache[i] = g_shm_cache[--g_shm_cached];
+        return;
+    }
+}
+
+/**
+ * Number of segments still attached, for the leak check at exit.
+ */
+static inline size_t
+zshm_attached(void) {
+    return g_shm_cached;
+}
+
 /**
  * Mark shared memory for destruction.
  */
@@ -341,6 +861,50 @@ get_workers(size_t shmid) {
     return (worker_t *)zshmat(shmid);
 }
 
+/**
+ * Helper to attach and cast the dish catalog.
+ */
+static inline menu_t *
+get_menu(size_t shmid) {
+    return (menu_t *)zshmat(shmid);
+}
+
+/* =========================================================================
+ * Implementation: Dish Catalog
+ * ========================================================================= */
+
+/**
+ * Get the i-th dish of a category (i < menu->cat[type].size).
+ */
+static inline dish_slot_t *
+menu_slot(menu_t *menu, dish_type type, size_t i) {
+    return &menu->slots[menu->cat[type].first + i];
+}
+
+/**
+ * Constant time lookup of a dish by id, NULL if the id is unknown.
+ */
+static inline dish_slot_t *
+menu_find(menu_t *menu, dish_type type, size_t id) {
+    if (id >= menu->cat[type].nof_id)
+        return NULL;
+
+    const ssize_t *index = (const ssize_t *)&menu->slots[menu->nof_slots];
+    const ssize_t  slot  = index[menu->cat[type].index + id];
+
+    return slot < 0 ? NULL : &menu->slots[slot];
+}
+
+/**
+ * Total portions left in a category.
+ */
+static inline size_t
+menu_leftovers(menu_t *menu, dish_type type) {
+    size_t left = 0;
+    it(i, 0, menu->cat[type].size) left += menu_slot(menu, type, i)->quantity;
+    return left;
+}
+
 /* =========================================================================
  * Implementation: Message Queue IPC
  * ========================================================================= */
@@ -357,6 +921,37 @@ zmsgget(const key_t key, const int mode) {
     return (size_t)result;
 }
 
+/**
+ * Number of messages currently waiting in a queue.
+ */
+static inline size_t
+zmsgqnum(const size_t qid) {
+    struct msqid_ds info;
+    if (msgctl((int)qid, IPC_STAT, &info) == -1)
+        return 0;
+
+    return (size_t)info.msg_qnum;
+}
+
+/**
+ * Requests waiting at a station: those in its queue and those kept back by
+ * its workers under the aging discipline.
+ */
+static inline size_t
+station_backlog(const simctx_t *ctx, const station *st) {
+    return zmsgqnum(ctx->id_msg_q[st->type]) +
+           __atomic_load_n(&st->held, __ATOMIC_RELAXED);
+}
+
+/**
+ * Workers holding a seat at a station: the seats less the free ones. The
+ * roster (wk_data.cap) can be larger, the extra workers wait for a seat.
+ */
+static inline int
+station_active(const simctx_t *ctx, const station *st) {
+    return ctx->config.nof_wk_seats[st->type] - sem_getval(st->wk_data.sem);
+}
+
 /**
  * Remove a message queue.
  */
@@ -369,6 +964,24 @@ msg_kill(int id) {
  * Implementation: File Operations
  * ========================================================================= */
 
+/**
+ * Path of a file in the run directory, SIM_RUN_DIR or data/ if unset.
+ * Children inherit the variable, so every process of a simulation and the
+ * external tools started with it agree on the same files.
+ * The result lives in a static buffer, valid until the next call.
+ */
+static inline const char *
+run_path(const char *name) {
+    static char path[PATH_MAX];
+    const char *dir = getenv(RUN_DIR_ENV);
+
+    if (dir == NULL || *dir == '\0')
+        dir = RUN_DIR_DEFAULT;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    return path;
+}
+
 /**
  * Safe fopen wrapper.
  */
@@ -420,17 +1033,24 @@ fclear(const char *filename) {
 /**
  * Appends simulation statistics to a CSV file.
  * Handles header generation if the file is new/empty.
+ * @param roster Workers the day started with at every station.
  */
 static inline void
-save_stats_csv(const simctx_t *ctx, const station *stations, const size_t day) {
-    FILE *file = fopen("data/stats.csv", "a");
+save_stats_csv(
+    const simctx_t *ctx,
+    const station  *stations,
+    menu_t         *menu,
+    const size_t    day,
+    const size_t   *roster
+) {
+    FILE *file = fopen(run_path("stats.csv"), "a");
     if (!file) {
         if (DEBUG)
             perror("Could not open CSV file");
         return;
     }
 
-    const size_t users_served_day = (size_t)sem_getval(ctx->sem[cl_end]);
+    const size_t users_served_day = (size_t)ctx->day.users_in;
     const size_t users_unserved_day =
         (size_t)ctx->config.nof_users - users_served_day;
 
@@ -439,25 +1059,58 @@ save_stats_csv(const simctx_t *ctx, const station *stations, const size_t day) {
     const size_t srv_caffe   = stations[COFFEE_BAR].stats.served_dishes;
     const size_t srv_tot     = srv_primi + srv_secondi + srv_caffe;
 
-    size_t left_primi = 0;
-    it(k, 0, ctx->avl_dishes[FIRST_COURSE].size) {
-        left_primi += ctx->avl_dishes[FIRST_COURSE].data[k].quantity;
-    }
+    const size_t left_primi   = menu_leftovers(menu, FIRST);
+    const size_t left_secondi = menu_leftovers(menu, MAIN);
 
-    size_t left_secondi = 0;
-    it(k, 0, ctx->avl_dishes[MAIN_COURSE].size) {
-        left_secondi += ctx->avl_dishes[MAIN_COURSE].data[k].quantity;
+    const size_t earn_day   = stations[CHECKOUT].stats.earnings;
+    size_t       breaks_day    = 0;
+    size_t       transfers_day = 0;
+    size_t       stolen_day    = 0;
+    size_t       worked_day    = 0;
+    size_t       scale_up_day  = 0;
+    size_t       scale_dn_day  = 0;
+    size_t       elastic_day   = 0;
+    size_t       forced_day    = 0;
+    size_t       stockout_day  = 0;
+    size_t       wait_day[REQ_CLASSES][WAIT_BUCKETS] = {{0}};
+    it(i, 0, NOF_STATIONS) {
+        breaks_day += stations[i].stats.total_breaks;
+        transfers_day += stations[i].stats.transfers;
+        stolen_day += stations[i].stats.stolen;
+        worked_day += stations[i].stats.worked_time;
+        scale_up_day += stations[i].stats.scale_up;
+        scale_dn_day += stations[i].stats.scale_down;
+        elastic_day += stations[i].stats.elastic_time;
+        forced_day += stations[i].stats.forced_breaks;
+        stockout_day += stations[i].stats.stockouts;
+        it(c, 0, REQ_CLASSES) it(b, 0, WAIT_BUCKETS) {
+            wait_day[c][b] += stations[i].stats.wait_hist[c][b];
+        }
     }
+    const size_t wait_p95_day = class_percentile(wait_day, REQ_CLASSES, 0.95);
 
-    const size_t earn_day   = stations[CHECKOUT].stats.earnings;
-    size_t       breaks_day = 0;
-    it(i, 0, NOF_STATIONS) breaks_day += stations[i].stats.total_breaks;
+    /* Per class waits where ticket holders get their priority */
+    size_t cassa[REQ_CLASSES][WAIT_BUCKETS];
+    memcpy(cassa, stations[CHECKOUT].stats.wait_hist, sizeof(cassa));
+    const size_t p50_ticket = class_percentile(cassa, 0, 0.50);
+    const size_t p95_ticket = class_percentile(cassa, 0, 0.95);
+    const size_t p50_other  = class_percentile(cassa, 1, 0.50);
+    const size_t p95_other  = class_percentile(cassa, 1, 0.95);
+
+    const size_t payments_day = stations[CHECKOUT].stats.payments;
+    const size_t cassa_peak   = stations[CHECKOUT].stats.queue_peak;
 
     const double avg_breaks_day =
         ctx->config.nof_workers > 0
             ? (double)breaks_day / ctx->config.nof_workers
             : 0.0;
 
+    /* Fraction of the paid worker minutes (roster and elastic) spent serving */
+    const double staffed_day =
+        (double)ctx->config.nof_workers * WORK_DAY_MINUTES + elastic_day;
+    const double utilization_day =
+        staffed_day > 0 ? (double)worked_day / staffed_day : 0.0;
+
     const size_t glob_unserved = ctx->global_stats.users_not_served;
     const size_t glob_earn     = ctx->global_stats.earnings;
 
@@ -478,17 +1131,32 @@ save_stats_csv(const simctx_t *ctx, const station *stations, const size_t day) {
             "Total_Dishes,First_Course_Served,Main_Course_Served,Coffee_Served,"
             "Leftover_First,Leftover_Main,"
             "Earnings_Day,Total_Breaks_Day,Avg_Breaks_Day,"
-            "Total_Earnings,Avg_Earnings_Day\n"
+            "Total_Earnings,Avg_Earnings_Day,"
+            "Transfers_Day,Stolen_Day,Utilization_Day,"
+            "Scale_Up_Day,Scale_Down_Day,Elastic_Minutes_Day,"
+            "Forced_Breaks_Day,Wait_P95_Day,"
+            "Checkout_Wait_P50_Ticket,Checkout_Wait_P95_Ticket,"
+            "Checkout_Wait_P50_NoTicket,Checkout_Wait_P95_NoTicket,"
+            "Checkout_Payments_Day,Checkout_Queue_Peak_Day,"
+            "Workers_First,Workers_Main,Workers_Coffee,Workers_Checkout,"
+            "Refill_First,Refill_Main,Stockouts_Day\n"
         );
     }
 
     fprintf(
         file,
-        "%zu,%zu,%zu,%zu,%.2f,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%.2f,%zu,%.2f\n",
+        "%zu,%zu,%zu,%zu,%.2f,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%.2f,%zu,%.2f,"
+        "%zu,%zu,%.3f,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,"
+        "%zu,%zu,%zu,%zu,%d,%d,%zu\n",
         day + 1, users_served_day, users_unserved_day, glob_unserved,
         avg_users_served, srv_tot, srv_primi, srv_secondi, srv_caffe,
         left_primi, left_secondi, earn_day, breaks_day, avg_breaks_day,
-        glob_earn, avg_earn
+        glob_earn, avg_earn, transfers_day, stolen_day, utilization_day,
+        scale_up_day, scale_dn_day, elastic_day, forced_day, wait_p95_day,
+        p50_ticket, p95_ticket, p50_other, p95_other, payments_day, cassa_peak,
+        roster[FIRST_COURSE], roster[MAIN_COURSE], roster[COFFEE_BAR],
+        roster[CHECKOUT], ctx->config.avg_refill[FIRST],
+        ctx->config.avg_refill[MAIN], stockout_day
     );
 
     fclose(file);
@@ -513,7 +1181,7 @@ zprintf(const sem_t sem_id, const char *fmt, ...) {
         vprintf(fmt, args);
         fflush(stdout);
     } else {
-        FILE *f = fopen("data/simulation.log", "a");
+        FILE *f = fopen(run_path("simulation.log"), "a");
         if (f) {
             vfprintf(f, fmt, args);
             fclose(f);
@@ -539,6 +1207,148 @@ znsleep(const size_t wait_time) {
     nanosleep(&req, NULL);
 }
 
+/**
+ * Monotonic clock in microseconds, truncated to 32 bits to fit a message.
+ * It wraps every ~71 real minutes, differences stay right across the wrap.
+ */
+static inline uint32_t
+zstamp(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((size_t)now.tv_sec * 1000000 + (size_t)now.tv_nsec / 1000);
+}
+
+/**
+ * Simulated minutes elapsed since a zstamp() timestamp.
+ */
+static inline size_t
+zminutes_since(const uint32_t since) {
+    const uint32_t elapsed_us = zstamp() - since;
+    return (size_t)elapsed_us * 1000 / N_NANO_SECS;
+}
+
+/**
+ * Histogram bucket of a wait: exact below WAIT_LINEAR_BUCKETS minutes, then
+ * groups of 8 buckets each twice as wide as the previous group.
+ */
+static inline size_t
+hist_bucket(const size_t minutes) {
+    if (minutes < WAIT_LINEAR_BUCKETS)
+        return minutes;
+
+    size_t idx   = WAIT_LINEAR_BUCKETS;
+    size_t lo    = WAIT_LINEAR_BUCKETS;
+    size_t width = 2;
+    while (minutes >= lo + 8 * width && idx + 8 < WAIT_BUCKETS) {
+        lo += 8 * width;
+        width *= 2;
+        idx += 8;
+    }
+
+    idx += (minutes - lo) / width;
+    return idx < WAIT_BUCKETS ? idx : WAIT_BUCKETS - 1;
+}
+
+/**
+ * Shortest wait (in minutes) that falls in a histogram bucket.
+ */
+static inline size_t
+hist_floor(const size_t bucket) {
+    if (bucket < WAIT_LINEAR_BUCKETS)
+        return bucket;
+
+    const size_t group = (bucket - WAIT_LINEAR_BUCKETS) / 8;
+    const size_t width = (size_t)2 << group;
+    /* Each group spans 8 * width minutes: 16 * (2^group - 1) before it */
+    const size_t lo    = WAIT_LINEAR_BUCKETS + 16 * (((size_t)1 << group) - 1);
+    return lo + ((bucket - WAIT_LINEAR_BUCKETS) % 8) * width;
+}
+
+/**
+ * Adds a wait to a WAIT_BUCKETS histogram.
+ */
+static inline void
+hist_add(size_t *hist, const size_t minutes) {
+    hist[hist_bucket(minutes)]++;
+}
+
+/**
+ * Smallest wait (in minutes) covering a fraction p of a histogram's samples,
+ * 0 if it is empty.
+ */
+static inline size_t
+hist_percentile(const size_t *hist, const double p) {
+    size_t total = 0;
+    it(i, 0, WAIT_BUCKETS) total += hist[i];
+    if (total == 0)
+        return 0;
+
+    const size_t rank = (size_t)(p * (double)total + 0.5);
+    size_t       seen = 0;
+    it(i, 0, WAIT_BUCKETS) {
+        seen += hist[i];
+        if (seen >= rank && seen > 0)
+            return hist_floor(i);
+    }
+    return hist_floor(WAIT_BUCKETS - 1);
+}
+
+/**
+ * Wait percentile of one request class, or of all of them with
+ * cls == REQ_CLASSES.
+ */
+static inline size_t
+class_percentile(
+    size_t       hist[REQ_CLASSES][WAIT_BUCKETS],
+    const size_t cls,
+    const double p
+) {
+    if (cls < REQ_CLASSES)
+        return hist_percentile(hist[cls], p);
+
+    size_t all[WAIT_BUCKETS] = {0};
+    it(c, 0, REQ_CLASSES) it(b, 0, WAIT_BUCKETS) all[b] += hist[c][b];
+    return hist_percentile(all, p);
+}
+
+/**
+ * Mean wait (in minutes) over every request class, 0 if there is none.
+ * A wide bucket counts as the middle of the minutes it spans.
+ */
+static inline double
+class_mean(size_t hist[REQ_CLASSES][WAIT_BUCKETS]) {
+    double sum   = 0;
+    size_t total = 0;
+
+    it(b, 0, WAIT_BUCKETS) {
+        const double lo  = (double)hist_floor(b);
+        const double hi  = b + 1 < WAIT_BUCKETS ? hist_floor(b + 1) - 1.0 : lo;
+        size_t       cnt = 0;
+        it(c, 0, REQ_CLASSES) cnt += hist[c][b];
+
+        sum += (double)cnt * (lo + hi) / 2;
+        total += cnt;
+    }
+    return total > 0 ? sum / (double)total : 0;
+}
+
+/**
+ * Slots in every worker segment: the roster plus the elastic workers budget.
+ */
+static inline size_t
+wk_slots(const conf_t *conf) {
+    return (size_t)conf->nof_workers + (size_t)conf->autoscale_budget;
+}
+
+/**
+ * First minute of the day a worker that already took `taken` breaks may take
+ * the next one with the load aware policy: breaks are spread evenly.
+ */
+static inline size_t
+break_slot(const conf_t *conf, const size_t taken) {
+    return (taken + 1) * WORK_DAY_MINUTES / ((size_t)conf->nof_pause + 1);
+}
+
 /**
  * String to size_t.
  */
@@ -581,11 +1391,20 @@ itos(const int val) {
  */
 static inline size_t
 get_service_time(size_t avg_time, size_t percent) {
+    return service_time_at(avg_time, percent, (unsigned)rand());
+}
+
+/**
+ * Like get_service_time, with the rand() value given: a recorded draw gives
+ * the same time again.
+ */
+static inline size_t
+service_time_at(size_t avg_time, size_t percent, const unsigned draw) {
     if (avg_time == 0)
         return 0;
 
     const size_t delta     = (avg_time * percent) / 100;
-    const long   variation = (long)(rand() % (2 * delta + 1) - delta);
+    const long   variation = (long)(draw % (2 * delta + 1) - delta);
     const long   result    = (long)avg_time - variation;
 
     return (result > 0) ? (size_t)result : 0;
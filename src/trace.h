@@ -0,0 +1,408 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "const.h"
+#include "objects.h"
+#include "tools.h"
+
+/* =========================================================================
+ * Record / replay
+ * --record saves every random draw that shapes the workload into a binary
+ * trace, --replay feeds them back, so two builds or two policies can be
+ * compared under the same clients:
+ *   - group sizes (init_groups) and ticket flags (init_client), once
+ *   - per day and client: the dishes of pick_dishes and the rand() behind
+ *     each station's service time (get_service_time)
+ *   - per day: the refill intervals and, with an arrival profile, the users
+ *     drawn every minute
+ * Each draw goes through one call taking the live value: recording stores
+ * and returns it, replaying returns the recorded one, otherwise it is
+ * returned as is. A client is known by its spawn index, which workers find
+ * from the request pid through a small hash in the shared trace_t.
+ *
+ * File, host byte order:
+ *   header  "OGTR", u32 version, u32 users, u32 groups,
+ *           u8 size[groups], u8 ticket[users]
+ *   day     u32 users, u32 refills, u32 minutes,
+ *           users x {i32 dishes[3], u32 srvc[4], u32 set},
+ *           u16 refill[refills], u16 arrivals[minutes]
+ * ========================================================================= */
+
+#define TRACE_MAGIC "OGTR"
+#define TRACE_VERSION 1
+/* Refill intervals kept per day, one every minute at most */
+#define TRACE_MAX_REFILLS WORK_DAY_MINUTES
+
+/* Coordinator side */
+static struct {
+    FILE        *file;
+    trace_mode_t mode;
+    uint32_t users;
+    uint32_t groups;
+    uint8_t  size[MAX_TOTAL_USERS];
+    uint8_t  ticket[MAX_TOTAL_USERS];
+
+    uint32_t refills; // estratti oggi (record) o gia' usati (replay)
+    uint32_t n_refill; // presenti nella giornata letta (replay)
+    uint16_t refill[TRACE_MAX_REFILLS];
+    uint16_t arrivals[WORK_DAY_MINUTES];
+    bool     has_arrivals;
+} g_trace;
+
+/**
+ * @brief Shared table of the current day, NULL when there is no trace.
+ */
+static inline trace_t *
+trace_get(const simctx_t *ctx) {
+    if (ctx->trace_mode == TRACE_OFF)
+        return NULL;
+    return (trace_t *)zshmat(ctx->trace_shm);
+}
+
+/**
+ * @brief Reads exactly n bytes of the trace, the file must be complete.
+ */
+static inline void
+trace_read(void *buf, const size_t n) {
+    if (fread(buf, 1, n, g_trace.file) != n)
+        panic("ERROR: Trace file truncated or corrupted\n");
+}
+
+/**
+ * @brief Opens the trace file, before any IPC resource exists.
+ * * Replaying reads the header at once: the trace must come from a run with
+ * the same number of users.
+ */
+static inline void
+trace_open(const trace_mode_t mode, const char *path, const conf_t *conf) {
+    g_trace.mode = mode;
+    if (mode == TRACE_OFF)
+        return;
+
+    g_trace.file = zfopen(path, mode == TRACE_RECORD ? "wb" : "rb");
+    if (mode == TRACE_RECORD)
+        return;
+
+    char     magic[4];
+    uint32_t version;
+    trace_read(magic, sizeof(magic));
+    trace_read(&version, sizeof(version));
+    if (memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0 ||
+        version != TRACE_VERSION)
+        panic("ERROR: %s is not a trace of this simulator\n", path);
+
+    trace_read(&g_trace.users, sizeof(g_trace.users));
+    trace_read(&g_trace.groups, sizeof(g_trace.groups));
+    if (g_trace.users != (uint32_t)conf->nof_users ||
+        g_trace.groups > g_trace.users)
+        panic(
+            "ERROR: The trace has %u users, the config %d\n", g_trace.users,
+            conf->nof_users
+        );
+    trace_read(g_trace.size, g_trace.groups);
+    trace_read(g_trace.ticket, g_trace.users);
+}
+
+/**
+ * @brief Creates the shared table of an open trace, before the groups are
+ * made.
+ */
+static inline void
+trace_attach(simctx_t *ctx) {
+    ctx->trace_mode = g_trace.mode;
+    if (g_trace.mode == TRACE_OFF)
+        return;
+
+    ctx->trace_shm = zshmget(sizeof(trace_t));
+    memset(trace_get(ctx), 0, sizeof(trace_t));
+}
+
+/**
+ * @brief Size of a new group in init_groups.
+ */
+static inline size_t
+trace_group_size(const simctx_t *ctx, const size_t group, const size_t live) {
+    if (ctx->trace_mode == TRACE_RECORD) {
+        g_trace.size[group] = (uint8_t)live;
+        g_trace.groups      = (uint32_t)group + 1;
+    } else if (ctx->trace_mode == TRACE_REPLAY && group < g_trace.groups) {
+        return g_trace.size[group];
+    }
+    return live;
+}
+
+/**
+ * @brief Ticket flag of the client spawned with index idx.
+ * * Users added at run time are not part of the workload, they always draw.
+ */
+static inline bool
+trace_ticket(const simctx_t *ctx, const size_t idx, const bool live) {
+    if (idx >= (size_t)ctx->config.nof_users)
+        return live;
+    if (ctx->trace_mode == TRACE_RECORD) {
+        g_trace.ticket[idx] = live;
+        g_trace.users       = (uint32_t)idx + 1;
+    } else if (ctx->trace_mode == TRACE_REPLAY) {
+        return g_trace.ticket[idx];
+    }
+    return live;
+}
+
+/**
+ * @brief Writes the header once the initial groups are formed.
+ */
+static inline void
+trace_write_header(const simctx_t *ctx) {
+    if (ctx->trace_mode != TRACE_RECORD)
+        return;
+
+    const uint32_t version = TRACE_VERSION;
+    fwrite(TRACE_MAGIC, 1, 4, g_trace.file);
+    fwrite(&version, sizeof(version), 1, g_trace.file);
+    fwrite(&g_trace.users, sizeof(g_trace.users), 1, g_trace.file);
+    fwrite(&g_trace.groups, sizeof(g_trace.groups), 1, g_trace.file);
+    fwrite(g_trace.size, 1, g_trace.groups, g_trace.file);
+    fwrite(g_trace.ticket, 1, g_trace.users, g_trace.file);
+}
+
+/**
+ * @brief Prepares the table for a new day, before it is opened.
+ * * Replaying loads the next day of the trace; past its last day the
+ * simulation goes on with live draws.
+ */
+static inline void
+trace_day_begin(simctx_t *ctx) {
+    trace_t *trace = trace_get(ctx);
+    if (trace == NULL)
+        return;
+
+    it(i, 0, MAX_TOTAL_USERS) {
+        trace->client[i].set  = 0;
+        trace->client[i].used = 0;
+    }
+    g_trace.refills      = 0;
+    g_trace.n_refill     = 0;
+    g_trace.has_arrivals = false;
+    if (ctx->trace_mode == TRACE_RECORD)
+        return;
+
+    uint32_t head[3];
+    if (fread(head, sizeof(head[0]), 3, g_trace.file) != 3) {
+        zprintf(ctx->sem[out], "MAIN: Trace over, live draws from now on\n");
+        ctx->trace_mode = TRACE_OFF;
+        return;
+    }
+    if (head[0] > MAX_TOTAL_USERS || head[1] > TRACE_MAX_REFILLS ||
+        (head[2] != 0 && head[2] != WORK_DAY_MINUTES))
+        panic("ERROR: Trace file corrupted\n");
+
+    it(i, 0, head[0]) {
+        trace_client_t *c = &trace->client[i];
+        trace_read(c->dishes, sizeof(c->dishes));
+        trace_read(c->srvc, sizeof(c->srvc));
+        trace_read(&c->set, sizeof(c->set));
+    }
+    g_trace.n_refill = head[1];
+    trace_read(g_trace.refill, head[1] * sizeof(uint16_t));
+    g_trace.has_arrivals = head[2] != 0;
+    trace_read(g_trace.arrivals, head[2] * sizeof(uint16_t));
+}
+
+/**
+ * @brief Appends the draws of the day just closed.
+ * * Replaying only reports the draws the trace could not answer: any of them
+ * means the two runs stopped seeing the same workload.
+ */
+static inline void
+trace_day_end(simctx_t *ctx, const size_t day) {
+    trace_t *trace = trace_get(ctx);
+    if (trace == NULL)
+        return;
+
+    /* Where a run with the same seed and no trace draws again */
+    const uint32_t reused =
+        __atomic_exchange_n(&trace->reused, 0, __ATOMIC_RELAXED);
+    if (reused > 0)
+        zprintf(
+            ctx->sem[out],
+            "MAIN: Day %zu, %u service times repeated from the client's "
+            "earlier request at the station\n",
+            day + 1, reused
+        );
+
+    if (ctx->trace_mode == TRACE_REPLAY) {
+        const uint32_t misses =
+            __atomic_exchange_n(&trace->misses, 0, __ATOMIC_RELAXED);
+        if (misses > 0)
+            zprintf(
+                ctx->sem[out], "MAIN: Day %zu, %u draws not in the trace\n",
+                day + 1, misses
+            );
+        return;
+    }
+
+    const uint32_t head[3] = {
+        (uint32_t)ctx->config.nof_users, g_trace.refills,
+        g_trace.has_arrivals ? WORK_DAY_MINUTES : 0
+    };
+    fwrite(head, sizeof(head[0]), 3, g_trace.file);
+    it(i, 0, head[0]) {
+        const trace_client_t *c = &trace->client[i];
+        fwrite(c->dishes, sizeof(c->dishes), 1, g_trace.file);
+        fwrite(c->srvc, sizeof(c->srvc), 1, g_trace.file);
+        fwrite(&c->set, sizeof(c->set), 1, g_trace.file);
+    }
+    fwrite(g_trace.refill, sizeof(uint16_t), head[1], g_trace.file);
+    fwrite(g_trace.arrivals, sizeof(uint16_t), head[2], g_trace.file);
+    fflush(g_trace.file);
+}
+
+/**
+ * @brief Minutes until the next refill.
+ */
+static inline size_t
+trace_refill(const simctx_t *ctx, const size_t live) {
+    if (ctx->trace_mode == TRACE_RECORD && g_trace.refills < TRACE_MAX_REFILLS) {
+        g_trace.refill[g_trace.refills++] = (uint16_t)live;
+    } else if (ctx->trace_mode == TRACE_REPLAY &&
+               g_trace.refills < g_trace.n_refill) {
+        return g_trace.refill[g_trace.refills++];
+    }
+    return live;
+}
+
+/**
+ * @brief Users arriving in a minute of the day.
+ */
+static inline long
+trace_arrivals(const simctx_t *ctx, const size_t min, const long live) {
+    if (min >= WORK_DAY_MINUTES)
+        return live;
+    if (ctx->trace_mode == TRACE_RECORD) {
+        g_trace.arrivals[min] = (uint16_t)live;
+        g_trace.has_arrivals  = true;
+    } else if (ctx->trace_mode == TRACE_REPLAY && g_trace.has_arrivals) {
+        return g_trace.arrivals[min];
+    }
+    return live;
+}
+
+/**
+ * @brief Closes the trace and removes its table.
+ */
+static inline void
+trace_close(simctx_t *ctx) {
+    if (g_trace.file == NULL)
+        return;
+
+    fclose(g_trace.file);
+    g_trace.file = NULL;
+    zshmdt(ctx->trace_shm);
+    shm_kill(ctx->trace_shm);
+}
+
+/* Client and worker side */
+
+/**
+ * @brief Publishes the pid of the client with spawn index idx, so workers
+ * can find its draws. Called by the client itself before its first request.
+ * @return int 0 on success or without a trace, -1 if the table is full.
+ */
+static inline int
+trace_register(const simctx_t *ctx, const pid_t pid, const size_t idx) {
+    trace_t *trace = trace_get(ctx);
+    if (trace == NULL)
+        return 0;
+
+    const uint64_t entry = (uint64_t)(uint32_t)pid << 32 | (uint32_t)idx;
+    size_t         k     = (size_t)pid % TRACE_PID_SLOTS;
+    it(probe, 0, TRACE_PID_SLOTS) {
+        uint64_t free = 0;
+        if (__atomic_compare_exchange_n(
+                &trace->pids[k], &free, entry, false, __ATOMIC_RELAXED,
+                __ATOMIC_RELAXED
+            ))
+            return 0;
+        k = (k + 1) % TRACE_PID_SLOTS;
+    }
+    return -1;
+}
+
+/**
+ * @brief Spawn index of a registered client, -1 if unknown.
+ */
+static inline ssize_t
+trace_find(const trace_t *trace, const pid_t pid) {
+    size_t k = (size_t)pid % TRACE_PID_SLOTS;
+    it(probe, 0, TRACE_PID_SLOTS) {
+        const uint64_t entry = __atomic_load_n(&trace->pids[k], __ATOMIC_RELAXED);
+        if (entry == 0)
+            return -1;
+        if ((pid_t)(entry >> 32) == pid)
+            return (ssize_t)(entry & UINT32_MAX);
+        k = (k + 1) % TRACE_PID_SLOTS;
+    }
+    return -1;
+}
+
+/**
+ * @brief The client's dishes of the day, dishes holds the live pick.
+ */
+static inline void
+trace_dishes(const simctx_t *ctx, const size_t idx, ssize_t *dishes) {
+    trace_t *trace = trace_get(ctx);
+    if (trace == NULL || idx >= MAX_TOTAL_USERS)
+        return;
+
+    trace_client_t *c = &trace->client[idx];
+    if (ctx->trace_mode == TRACE_REPLAY) {
+        if (c->set & TRACE_DISHES) {
+            it(i, 0, MENU_CATEGORIES) dishes[i] = c->dishes[i];
+        } else {
+            __atomic_add_fetch(&trace->misses, 1, __ATOMIC_RELAXED);
+        }
+        return;
+    }
+
+    it(i, 0, MENU_CATEGORIES) c->dishes[i] = (int32_t)dishes[i];
+    __atomic_or_fetch(&c->set, TRACE_DISHES, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief rand() behind the service time of a client at a station.
+ * * One draw per client, station and day: a client asking again for another
+ * dish gets the same time, which keeps recording and replaying in step. A run
+ * without a trace draws again instead, so the repeats are counted and logged
+ * by trace_day_end.
+ * @param live Fresh rand(), used when there is nothing to record or replay.
+ */
+static inline unsigned
+trace_service(const simctx_t *ctx, const pid_t client, const loc_t station,
+              const unsigned live) {
+    trace_t *trace = trace_get(ctx);
+    if (trace == NULL || station >= NOF_STATIONS)
+        return live;
+
+    const ssize_t idx = trace_find(trace, client);
+    if (idx < 0 || idx >= MAX_TOTAL_USERS)
+        return live;
+
+    trace_client_t *c   = &trace->client[idx];
+    const uint32_t  bit = 1u << station;
+    if (__atomic_fetch_or(&c->used, bit, __ATOMIC_RELAXED) & bit)
+        __atomic_add_fetch(&trace->reused, 1, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&c->set, __ATOMIC_ACQUIRE) & bit)
+        return c->srvc[station];
+
+    if (ctx->trace_mode == TRACE_REPLAY)
+        __atomic_add_fetch(&trace->misses, 1, __ATOMIC_RELAXED);
+    c->srvc[station] = live;
+    __atomic_or_fetch(&c->set, bit, __ATOMIC_RELEASE);
+    return live;
+}
+
+#endif
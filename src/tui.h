@@ -54,6 +54,7 @@ static const char *ANSI_COLORS[] = {
 };
 
 #define ANSI_HOME "\x1b[H"
+#define ANSI_GOTO "\x1b[%zu;%zuH" // riga e colonna, da 1
 #define ANSI_CLEAR "\x1b[2J"
 #define ANSI_HIDE_CURSOR "\x1b[?25l"
 #define ANSI_SHOW_CURSOR "\x1b[?25h"
@@ -65,13 +66,22 @@ typedef struct {
     uint8_t  color;
 } Cell;
 
+// Doppio buffer: si disegna in cells (back), front e' quello che il
+// terminale mostra gia'. s_display scrive solo le celle diverse.
 typedef struct {
-    size_t rows;
-    size_t cols;
-    size_t len;
-    Cell  *cells;
+    size_t  rows;
+    size_t  cols;
+    size_t  len;
+    Cell   *cells;
+    Cell   *front;
+    char   *out;       // buffer di uscita, allocato una volta sola
+    size_t  out_cap;
+    uint8_t term_color; // colore attivo sul terminale
 } screen;
 
+// Byte massimi per cella: spostamento cursore, colore e UTF-8
+#define CELL_OUT_MAX 32
+
 static struct termios orig_termios;
 
 /* ================= UTF-8 HELPERS (INLINE) ================= */
@@ -190,23 +200,38 @@ s_clear(screen *s) {
     }
 }
 
+// Dimentica cio' che il terminale mostra: il prossimo frame e' completo
+static inline void
+s_invalidate(screen *s) {
+    for (size_t i = 0; i < s->len; i++) {
+        s->front[i].ch    = 0;
+        s->front[i].color = COL_RESET;
+    }
+    s->term_color = COL_RESET;
+}
+
 static inline screen *
 init_screen(size_t rows, size_t cols) {
-    screen *s = (screen *)zmalloc(sizeof(screen));
-    s->rows   = rows;
-    s->cols   = cols;
-    s->len    = rows * cols;
-    s->cells = (Cell *)zmalloc(s->len * sizeof(Cell));
+    screen *s  = (screen *)zmalloc(sizeof(screen));
+    s->rows    = rows;
+    s->cols    = cols;
+    s->len     = rows * cols;
+    s->cells   = (Cell *)zmalloc(s->len * sizeof(Cell));
+    s->front   = (Cell *)zmalloc(s->len * sizeof(Cell));
+    s->out_cap = s->len * CELL_OUT_MAX + 128;
+    s->out     = (char *)zmalloc(s->out_cap);
 
     s_clear(s);
+    s_invalidate(s);
     return s;
 }
 
 static inline void
 free_screen(screen *s) {
     if (s) {
-        if (s->cells)
-            free(s->cells);
+        free(s->cells);
+        free(s->front);
+        free(s->out);
         free(s);
     }
 }
@@ -278,15 +303,18 @@ s_draw_text(
     if (len < 0)
         return;
 
+    // Le scritte del dashboard stanno quasi sempre nel buffer sullo stack
+    char   small[256];
     size_t size = (size_t)len + 1;
-    char  *buf  = (char *)zmalloc(size);
+    char  *buf  = size <= sizeof(small) ? small : (char *)zmalloc(size);
 
     va_start(ap, fmt);
     vsnprintf(buf, size, fmt, ap);
     va_end(ap);
 
     s_write(s, x, y, buf, color);
-    free(buf);
+    if (buf != small)
+        free(buf);
 }
 
 static inline void
@@ -375,48 +403,49 @@ draw_box(screen *s, size_t x, size_t y, size_t w, size_t h, uint8_t color) {
 
 /* ================= RENDERING ENGINE ================= */
 
+// Scrive solo le celle cambiate dall'ultimo frame. Una sequenza di celle
+// contigue costa un solo spostamento del cursore, e il colore viene
+// cambiato solo quando e' diverso da quello attivo sul terminale. A fine
+// frame il colore torna quello di default, cosi' non resta al terminale.
 static inline void
 s_display(screen *s) {
-    size_t max_render_size = (s->len * 12) + 128;
-
-    char *out_buf = (char *)zmalloc(max_render_size);
-    char *ptr     = out_buf;
+    char  *ptr    = s->out;
+    size_t cursor = SIZE_MAX; // indice della cella sotto il cursore
 
-    memcpy(ptr, ANSI_HOME, sizeof(ANSI_HOME) - 1);
-    ptr += sizeof(ANSI_HOME) - 1;
-
-    uint8_t last_color = COL_RESET;
-
-    const char *col_str = ANSI_COLORS[COL_RESET];
-    size_t      col_len = strlen(col_str);
-    memcpy(ptr, col_str, col_len);
-    ptr += col_len;
+    for (size_t i = 0; i < s->len; i++) {
+        const Cell *c = &s->cells[i];
+        Cell       *f = &s->front[i];
 
-    for (size_t y = 0; y < s->rows; y++) {
-        for (size_t x = 0; x < s->cols; x++) {
-            Cell *c = &s->cells[y * s->cols + x];
+        if (c->ch == f->ch && c->color == f->color)
+            continue;
 
-            if (c->color != last_color) {
-                const char *new_col_str = ANSI_COLORS[c->color];
-                size_t      len         = strlen(new_col_str);
+        // A capo si riposiziona sempre: l'a capo automatico varia tra terminali
+        if (cursor != i || i % s->cols == 0)
+            ptr += sprintf(ptr, ANSI_GOTO, i / s->cols + 1, i % s->cols + 1);
 
-                memcpy(ptr, new_col_str, len);
-                ptr += len;
-                last_color = c->color;
-            }
+        if (c->color != s->term_color) {
+            const char *col_str = ANSI_COLORS[c->color];
+            size_t      col_len = strlen(col_str);
 
-            ptr += utf8_encode(ptr, c->ch);
+            memcpy(ptr, col_str, col_len);
+            ptr += col_len;
+            s->term_color = c->color;
         }
-        if (y < s->rows - 1)
-            *ptr++ = '\n'; 
-    }
 
-    memcpy(ptr, ANSI_COLORS[COL_RESET], strlen(ANSI_COLORS[COL_RESET]));
-    ptr += strlen(ANSI_COLORS[COL_RESET]);
+        ptr += utf8_encode(ptr, c->ch);
+        *f     = *c;
+        cursor = i + 1;
+    }
 
-    write(STDOUT_FILENO, out_buf, (size_t)(ptr - out_buf));
+    if (s->term_color != COL_RESET) {
+        const size_t col_len = strlen(ANSI_COLORS[COL_RESET]);
+        memcpy(ptr, ANSI_COLORS[COL_RESET], col_len);
+        ptr += col_len;
+        s->term_color = COL_RESET;
+    }
 
-    free(out_buf);
+    if (ptr != s->out)
+        write(STDOUT_FILENO, s->out, (size_t)(ptr - s->out));
 }
 
 static inline char
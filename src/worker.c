@@ -8,19 +8,42 @@
 #include <unistd.h>
 
 #include "const.h"
+#include "model.h"
 #include "msg.h"
 #include "objects.h"
 #include "tools.h"
+#include "trace.h"
+
+/* =========================================================================
+ * Global State
+ * ========================================================================= */
+
+/** Dish catalog, attached once at startup and shared by every day. */
+static menu_t *g_menu = NULL;
 
 /* =========================================================================
  * Prototypes
  * ========================================================================= */
 
-void work_with_pause(
-    simctx_t *ctx, station *st, size_t variance, msg_t *response, worker_t *self
+worker_t *work_with_pause(
+    simctx_t *ctx, station *sts, size_t idx, msg_t *response, worker_t *self
 );
 void work_shift(
-    simctx_t *ctx, station *st, size_t variance, msg_t *response, worker_t *self
+    simctx_t *ctx, station *sts, msg_t *response, worker_t *self
+);
+static inline bool break_due(
+    const simctx_t *ctx, const station *st, const worker_t *self, bool *forced
+);
+static bool try_break(simctx_t *ctx, station *st, worker_t *self);
+static ssize_t next_request(
+    simctx_t *ctx, station *st, msg_t *out, msg_t *held, const bool wait
+);
+static ssize_t wfq_request(
+    simctx_t *ctx, station *st, const size_t qid, msg_t *out, const bool wait
+);
+static inline ssize_t steal_request(
+    simctx_t *ctx, station *sts, const worker_t *self, msg_t *response,
+    loc_t *served
 );
 void serve_client(
     const worker_t *self,
@@ -29,15 +52,19 @@ void serve_client(
     msg_t          *response,
     const double    variance
 );
-static inline void _serve_food(
-    simctx_t       *ctx,
-    const worker_t *self,
-    station        *st,
-    msg_t          *response,
-    size_t          time
+static inline void
+_serve_food(simctx_t *ctx, station *st, msg_t *response, size_t time);
+static inline void
+_serve_checkout(simctx_t *ctx, station *st, msg_t *response, size_t time);
+static worker_t *
+migrate(
+    simctx_t *ctx, station *sts, const size_t idx, worker_t *self,
+    const bool transfer
+);
+static void work_elastic(
+    const shmid_t ctx_id, const shmid_t sts_id, const size_t idx,
+    const loc_t role
 );
-static inline void _serve_checkout(simctx_t *ctx, station *st, msg_t *response);
-static inline station *get_station(const shmid_t shmid, const loc_t role);
 
 /* =========================================================================
  * Functions
@@ -48,7 +75,8 @@ static inline station *get_station(const shmid_t shmid, const loc_t role);
  * * It initializes signal handling, parses IPC identifiers from arguments,
  * and enters the main simulation loop where it waits for the start of a day.
  * * @param argc Argument count.
- * @param argv Arguments: {exec_name, ctx_shmid, sts_shmid, worker_idx, role}.
+ * @param argv Arguments: {exec_name, ctx_shmid, sts_shmid, worker_idx, role,
+ * [spawn]}, spawn > 0 for the n-th elastic worker of the run.
  * @return int Exit status.
  */
 int
@@ -57,14 +85,15 @@ main(int argc, char **argv) {
      * SHM flags. */
     signal(SIGINT, SIG_IGN);
 
-    if (argc != 5)
+    if (argc != 5 && argc != 6)
         panic("ERROR: Invalid worker arguments for pid: %d", getpid());
 
     /* Parse IPC identifiers and worker metadata from command line arguments */
     const shmid_t ctx_id = atos(argv[1]);
     const shmid_t sts_id = atos(argv[2]);
     const size_t  idx    = atos(argv[3]);
-    const loc_t   role   = atos(argv[4]);
+    loc_t         role   = atos(argv[4]);
+    const size_t  spawn  = argc == 6 ? atos(argv[5]) : 0;
 
     /* Setup SIGUSR1 handler for custom synchronization/interruptions */
     struct sigaction sa;
@@ -73,25 +102,42 @@ main(int argc, char **argv) {
     sa.sa_flags = 0;
     sigaction(SIGUSR1, &sa, NULL);
 
+    const simctx_t *boot = get_ctx(ctx_id);
+    g_menu               = get_menu(boot->menu_shm);
+    /* An elastic slot is reused: its stream follows the spawn, not the slot */
+    srand(stream_seed(
+        boot->seed, spawn > 0 ? SEED_ELASTIC | (uint32_t)spawn
+                              : SEED_WORKER | (uint32_t)idx
+    ));
+
+    /* Extra worker started by the autoscaler: lives for part of one day */
+    if (spawn > 0) {
+        work_elastic(ctx_id, sts_id, idx, role);
+        return 0;
+    }
+
     /* Main simulation loop: handles multiple working days */
+    uint32_t day = 0;
     while (true) {
         simctx_t *ctx = get_ctx(ctx_id);
 
         zprintf(ctx->sem[out], "WORKER: WAITING FOR DAY INITIALIZATION\n");
 
-        /* Wait for the "wall" semaphore: the master releases this when the day
-         * starts */
-        sem_wait(ctx->sem[wall]);
+        /* Park until the master opens the next day */
+        day = day_wait(ctx, day);
 
         /* Check if simulation was terminated while waiting */
         if (!ctx->is_sim_running)
             break;
 
-        station  *st  = get_station(sts_id, role);
+        /* The roster may change between days (ADAPTIVE_STAFFING) */
+        role = roster_role(&ctx->config, idx);
+
+        station  *sts = get_stations(sts_id);
+        station  *st  = &sts[role];
         worker_t *wks = get_workers(st->wk_data.shmid);
 
-        const size_t queue    = ctx->id_msg_q[role];
-        const size_t variance = var_srvc[role];
+        const size_t queue = ctx->id_msg_q[role];
         msg_t        response;
 
         /* Register self in the shared memory worker array */
@@ -100,18 +146,27 @@ main(int argc, char **argv) {
             .pid        = getpid(),
             .role       = role,
             .queue      = queue,
+            .next_role  = role,
             .paused     = true,
+            .activity   = WK_IDLE,
             .nof_pause  = 0,
             .pause_time = 0,
+            .elastic    = false,
         };
         worker_t *self = &wks[idx];
         sem_signal(st->sem);
 
         /* Enter the active working cycle for the current day */
-        work_with_pause(ctx, st, variance, &response, self);
+        self = work_with_pause(ctx, sts, idx, &response, self);
 
-        /* Wait for the master to signal the end of the day */
-        sem_wait(ctx->sem[wk_end]);
+        /* Moved during the day: go back home so tomorrow's roster is clean */
+        if (self->role != role) {
+            self->next_role = role;
+            migrate(ctx, sts, idx, self, false);
+        }
+
+        /* Leave the day, the last one out wakes the master */
+        day_leave(ctx, false);
         if (!ctx->is_sim_running) {
             zprintf(
                 ctx->sem[out], "WORKER %d: Day finished, exiting.\n", getpid()
@@ -123,20 +178,90 @@ main(int argc, char **argv) {
     return 0;
 }
 
+/**
+ * @brief Life of an elastic worker: it joins a station in the middle of the
+ * day, works without breaks and leaves for good when the coordinator retires
+ * it (next_role == EXIT) or when the day ends. It takes no part in the day
+ * barriers, the coordinator reaps it.
+ * * @param ctx_id Context segment.
+ * @param sts_id Stations segment.
+ * @param idx Slot reserved for the worker, past the roster ones.
+ * @param role Station to join.
+ */
+static void
+work_elastic(
+    const shmid_t ctx_id,
+    const shmid_t sts_id,
+    const size_t  idx,
+    const loc_t   role
+) {
+    simctx_t *ctx = get_ctx(ctx_id);
+    station  *sts = get_stations(sts_id);
+    station  *st  = &sts[role];
+    worker_t *wks = get_workers(st->wk_data.shmid);
+    msg_t     response;
+
+    sem_wait(st->sem);
+    if (!ctx->is_sim_running || !ctx->is_day_running) {
+        sem_signal(st->sem);
+        return;
+    }
+    wks[idx] = (worker_t){
+        .pid        = getpid(),
+        .role       = role,
+        .queue      = ctx->id_msg_q[role],
+        .next_role  = role,
+        .paused     = true,
+        .activity   = WK_IDLE,
+        .nof_pause  = 0,
+        .pause_time = 0,
+        .elastic    = true,
+    };
+    st->wk_data.cap++;
+    worker_t *self = &wks[idx];
+    sem_signal(st->sem);
+
+    zprintf(
+        ctx->sem[out], "WORKER %d: Elastic worker joining station %d\n",
+        getpid(), role
+    );
+
+    self = work_with_pause(ctx, sts, idx, &response, self);
+
+    /* Leave the station the worker ended at, it may have been moved */
+    st = &sts[self->role];
+    sem_wait(st->sem);
+    st->wk_data.cap--;
+    /* Retired, not sent home by the end of the day */
+    if (self->next_role == EXIT)
+        st->stats.scale_down++;
+    self->pid = 0;
+    sem_signal(st->sem);
+
+    zprintf(
+        ctx->sem[out], "WORKER %d: Elastic worker leaving station %d\n",
+        getpid(), st->type
+    );
+}
+
 /**
  * @brief Manages the worker's cycle between being active at a station and
- * taking breaks.
+ * taking breaks, moving to another station when the coordinator asks to.
  * * @param ctx Global simulation context.
- * @param st Station where the worker is assigned.
- * @param variance Service time variance for the specific role.
+ * @param sts Stations array.
+ * @param idx Global index of the worker.
  * @param response Buffer for message passing.
  * @param self Pointer to the worker's own data in shared memory.
+ * @return worker_t* The worker's record, which lives in the segment of the
+ * station it ended the day at.
  */
-void
+worker_t *
 work_with_pause(
-    simctx_t *ctx, station *st, size_t variance, msg_t *response, worker_t *self
+    simctx_t *ctx, station *sts, size_t idx, msg_t *response, worker_t *self
 ) {
     while (ctx->is_sim_running && ctx->is_day_running) {
+        station *st = &sts[self->role];
+
         zprintf(
             ctx->sem[out], "WORKER: id %d, role %d, WAITING FOR SERVICE SLOT\n",
             self->pid, self->role
@@ -152,7 +277,16 @@ work_with_pause(
         int res;
         do {
             res = sem_wait(st->wk_data.sem);
-        } while (res == -1 && errno == EINTR);
+        } while (res == -1 && errno == EINTR &&
+                 self->next_role == self->role);
+
+        /* Reassigned or retired while waiting for a slot */
+        if (res == -1 && self->next_role != self->role) {
+            if (self->next_role == EXIT)
+                break;
+            self = migrate(ctx, sts, idx, self, true);
+            continue;
+        }
 
         /* Track time spent waiting for a slot as 'pause_time' (idle time) */
         clock_gettime(CLOCK_REALTIME, &t_end);
@@ -162,50 +296,94 @@ work_with_pause(
 
         /* START ACTIVE SHIFT */
         self->paused = false;
-        work_shift(ctx, st, variance, response, self);
+        work_shift(ctx, sts, response, self);
 
-        /* RELEASE STATION SLOT (End of Shift / Taking a Break) */
+        /* RELEASE STATION SLOT (End of Shift / Taking a Break / Moving) */
         sem_signal(st->wk_data.sem);
 
+        if (self->next_role == EXIT)
+            break;
+        if (self->next_role != self->role) {
+            self = migrate(ctx, sts, idx, self, true);
+            continue;
+        }
+
+        /* The shift ended with the day, not with a break */
+        if (!self->paused)
+            continue;
+
         /* UPDATE GLOBAL STATISTICS */
         sem_wait(ctx->sem[shm]);
         st->stats.total_breaks++;
         sem_signal(ctx->sem[shm]);
 
         /* Process the break duration as a sleep period */
+        self->activity = WK_BREAK;
         self->pause_time += (size_t)ctx->config.pause_duration;
-        znsleep((size_t)ctx->config.pause_duration);
+        day_sleep(ctx, (size_t)ctx->config.pause_duration);
+        self->activity = WK_IDLE;
     }
+
+    return self;
 }
 
 /**
  * @brief Main processing loop for serving clients.
  * * Listens for messages on the queue, processes them based on role,
  * and occasionally decides to take a break based on probability.
+ * With work stealing enabled, an empty queue makes the worker serve a
+ * request waiting at another station it is skilled for.
  * * @param ctx Global simulation context.
- * @param st Assigned station.
- * @param variance Service time variance.
+ * @param sts Stations array, the worker is at sts[self->role].
  * @param response Buffer for client requests.
  * @param self Pointer to worker's SHM data.
  */
 void
-work_shift(
-    simctx_t *ctx, station *st, size_t variance, msg_t *response, worker_t *self
-) {
-    while (ctx->is_sim_running && ctx->is_day_running) {
+work_shift(simctx_t *ctx, station *sts, msg_t *response, worker_t *self) {
+    station *st = &sts[self->role];
+
+    /* Request kept back by the aging discipline (mtype 0 = none) */
+    msg_t held = {0};
+
+    while (ctx->is_sim_running && ctx->is_day_running &&
+           self->next_role == self->role) {
+        self->activity = WK_IDLE;
+
+        /* Station whose request is being served */
+        loc_t   served = self->role;
+        ssize_t res    = next_request(ctx, st, response, &held, false);
+        if (res < 0 && ctx->config.work_stealing)
+            res = steal_request(ctx, sts, self, response, &served);
+
+        /* About to wait on an empty queue: a good moment for a break */
+        if (res < 0 && ctx->config.break_policy == 1 &&
+            zmsgqnum(self->queue) == 0 && try_break(ctx, st, self))
+            break;
+
         /* Non-blocking-like receive: wait for messages matching the role's
          * queue */
-        const ssize_t res = recv_msg_np(self->queue, -DEFAULT, response);
-        if (res == -1 && errno == EINTR)
+        if (res < 0)
+            res = next_request(ctx, st, response, &held, true);
+        /* Interrupted, or the queue was removed with the day: nothing to
+         * serve, the loop condition decides whether the shift goes on */
+        if (res < 0)
             continue;
+        self->activity = WK_SERVING;
+
+        /* Time spent in the queue, for the report and the autoscaling */
+        const size_t waited = zminutes_since(response->sent_at);
+        sem_wait(sts[served].sem);
+        hist_add(sts[served].wait_win, waited);
+        hist_add(sts[served].stats.wait_hist[req_class(response)], waited);
+        sem_signal(sts[served].sem);
 
         /* Dispatch based on role. Note: TABLES and EXIT don't have workers. */
-        switch (self->role) {
+        switch (served) {
         case COFFEE_BAR:
         case FIRST_COURSE:
         case MAIN_COURSE:
         case CHECKOUT:
-            serve_client(self, ctx, st, response, variance);
+            serve_client(self, ctx, &sts[served], response, var_srvc[served]);
             break;
 
         case TABLE:
@@ -213,45 +391,275 @@ work_shift(
             panic("ERROR: Invalid worker role for pid: %d\n", getpid());
         }
 
-        /* Send response back to the specific client */
+        /* Send response back to the specific client, on the queue the
+         * request came from */
         response->mtype = response->client;
-        send_msg(self->queue, *response, sizeof(msg_t) - sizeof(long));
-
-        /* RANDOM BREAK LOGIC
-         * A worker has a 15% chance to take a break after serving a client,
-         * provided they haven't exceeded their daily break limit and
-         * they aren't the last worker at the station. */
-        if (self->nof_pause < (size_t)ctx->config.nof_pause) {
-            if ((rand() % 100) < 15) {
-                sem_wait(st->sem);
-
-                int free_seats     = sem_getval(st->wk_data.sem);
-                int active_workers = (int)st->wk_data.cap - free_seats;
-
-                if (active_workers > 1) {
-                    zprintf(
-                        ctx->sem[out],
-                        "WORKER %d: Taking a break (Break n.%zu/%d)\n",
-                        getpid(), self->nof_pause + 1, ctx->config.nof_pause
-                    );
-                    self->paused = true;
-                    self->nof_pause++;
-                    sem_signal(st->sem);
-                    break; /* Exit shift loop to return to work_with_pause */
-                }
-                sem_signal(st->sem);
-            }
+        send_msg(
+            ctx->id_msg_q[served], *response, sizeof(msg_t) - sizeof(long)
+        );
+
+        /* BREAK LOGIC: exit shift loop to return to work_with_pause. A
+         * worker keeping a request back serves it before resting. */
+        if (held.mtype == 0 && try_break(ctx, st, self))
+            break;
+    }
+
+    /* Leaving the station: whoever comes next serves the kept request */
+    if (held.mtype != 0) {
+        resend_msg(self->queue, &held);
+        __atomic_sub_fetch(&st->held, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Takes the next request of the station in its queue discipline order.
+ * * FIFO, priority and SESF are encoded by the clients in the mtype, so the
+ * lowest-mtype-first receive already follows them. Aging keeps back the
+ * oldest request without ticket and serves it once it has waited
+ * aging_minutes, or as soon as no ticket holder is waiting; each worker keeps
+ * at most one, a worker stealing from another station none. WFQ is handled
+ * by wfq_request.
+ * * @param ctx Global context.
+ * @param st Worker's station.
+ * @param out Buffer for the request.
+ * @param held Aging only, request kept back by this worker (mtype 0 = none),
+ * NULL when stealing.
+ * @param wait Block when nothing is queued.
+ * @return ssize_t The received size, -1 if nothing was taken.
+ */
+static ssize_t
+next_request(
+    simctx_t *ctx, station *st, msg_t *out, msg_t *held, const bool wait
+) {
+    const size_t  qid    = ctx->id_msg_q[st->type];
+    const ssize_t m_size = sizeof(msg_t) - sizeof(long);
+
+    switch (ctx->config.queue_discipline[st->type]) {
+    case QD_WFQ:
+        return wfq_request(ctx, st, qid, out, wait);
+
+    case QD_AGING:
+        if (held == NULL) {
+            if (try_recv_msg(qid, TICKET, out) >= 0 ||
+                try_recv_msg(qid, DEFAULT, out) >= 0)
+                return m_size;
+            break;
+        }
+        if (held->mtype == 0) {
+            if (try_recv_msg(qid, DEFAULT, held) >= 0)
+                __atomic_add_fetch(&st->held, 1, __ATOMIC_RELAXED);
+            else
+                held->mtype = 0;
+        }
+
+        /* Ticket holders first while the kept request is young enough */
+        if (held->mtype == 0 ||
+            zminutes_since(held->sent_at) < (size_t)ctx->config.aging_minutes) {
+            if (try_recv_msg(qid, TICKET, out) >= 0)
+                return m_size;
+        }
+        if (held->mtype != 0) {
+            *out        = *held;
+            held->mtype = 0;
+            __atomic_sub_fetch(&st->held, 1, __ATOMIC_RELAXED);
+            return m_size;
+        }
+        break;
+
+    case QD_FIFO:
+    case QD_PRIORITY:
+    case QD_SESF:
+    default:
+        if (try_recv_msg(qid, -DEFAULT, out) >= 0)
+            return m_size;
+        break;
+    }
+
+    return wait ? recv_msg_np(qid, -DEFAULT, out) : -1;
+}
+
+/**
+ * @brief Weighted fair queueing between ticket holders and the others.
+ * * Stride scheduling: the class with the lowest virtual pass is tried first
+ * and each request served moves its class forward by WFQ_STRIDE / weight, so
+ * over time classes are served in proportion to their weights. A class found
+ * empty is brought up to the served one, it can't save credit while idle.
+ * * @param ctx Global context.
+ * @param st Worker's station.
+ * @param qid Station queue.
+ * @param out Buffer for the request.
+ * @param wait Block when nothing is queued.
+ * @return ssize_t The received size, -1 if nothing was taken.
+ */
+static ssize_t
+wfq_request(
+    simctx_t *ctx, station *st, const size_t qid, msg_t *out, const bool wait
+) {
+    static const long cls_mtype[REQ_CLASSES] = {TICKET, DEFAULT};
+
+    sem_wait(st->sem);
+    const size_t first = st->wfq_pass[0] <= st->wfq_pass[1] ? 0 : 1;
+    sem_signal(st->sem);
+
+    ssize_t res   = -1;
+    size_t  tried = 0;
+    while (res < 0 && tried < REQ_CLASSES)
+        res = try_recv_msg(qid, cls_mtype[(first + tried++) % REQ_CLASSES], out);
+
+    if (res < 0) {
+        if (!wait)
+            return -1;
+        res   = recv_msg_np(qid, -DEFAULT, out);
+        tried = REQ_CLASSES + 1;
+        if (res < 0)
+            return res;
+    }
+
+    const size_t cls = out->mtype == TICKET ? 0 : 1;
+    sem_wait(st->sem);
+    st->wfq_pass[cls] += WFQ_STRIDE / (size_t)ctx->config.wfq_weight[cls];
+    /* Every class tried before the served one was empty */
+    if (tried > 1) {
+        it(c, 0, REQ_CLASSES) {
+            if ((size_t)c != cls && st->wfq_pass[c] < st->wfq_pass[cls])
+                st->wfq_pass[c] = st->wfq_pass[cls];
+        }
+    }
+    sem_signal(st->sem);
+
+    return res;
+}
+
+/**
+ * @brief Decides whether it is time for the worker's next break.
+ * * BREAK_POLICY 0 is the historical coin flip after every client. The load
+ * aware policy spreads the breaks over the day: break k becomes eligible at
+ * k / (nof_pause + 1) of the day and is taken as soon as the station has
+ * fewer queued requests than active workers. When the time left only just
+ * fits the remaining breaks, the break is due whatever the load.
+ * * @param ctx Global context.
+ * @param st Worker's station.
+ * @param self Current worker.
+ * @param forced Output, true when the break is taken for the deadline.
+ * @return true if the worker should go on break.
+ */
+static inline bool
+break_due(
+    const simctx_t *ctx, const station *st, const worker_t *self, bool *forced
+) {
+    *forced = false;
+    if (ctx->config.break_policy == 0)
+        return (rand() % 100) < BREAK_RANDOM_CHANCE;
+
+    const size_t left = (size_t)ctx->config.nof_pause - self->nof_pause;
+    const size_t now  = ctx->current_min;
+    if (now < break_slot(&ctx->config, self->nof_pause))
+        return false;
+
+    const size_t needed =
+        left * ((size_t)ctx->config.pause_duration + BREAK_DEADLINE_SLACK);
+    if (now + needed >= WORK_DAY_MINUTES) {
+        *forced = true;
+        return true;
+    }
+
+    const int active = station_active(ctx, st);
+    return zmsgqnum(self->queue) < (size_t)(active > 0 ? active : 1);
+}
+
+/**
+ * @brief Sends the worker on break if one is due.
+ * * Workers never exceed their daily break limit and never leave the station
+ * without an active worker, unless the break is forced: the day has no time
+ * left to postpone it. Elastic workers are only paid while needed and never
+ * take breaks.
+ * * @param ctx Global context.
+ * @param st Worker's station.
+ * @param self Current worker.
+ * @return true if the worker is now on break and must leave the shift loop.
+ */
+static bool
+try_break(simctx_t *ctx, station *st, worker_t *self) {
+    bool forced;
+    if (self->elastic || self->nof_pause >= (size_t)ctx->config.nof_pause ||
+        !break_due(ctx, st, self, &forced))
+        return false;
+
+    sem_wait(st->sem);
+
+    if (station_active(ctx, st) <= 1 && !forced) {
+        sem_signal(st->sem);
+        return false;
+    }
+
+    zprintf(
+        ctx->sem[out], "WORKER %d: Taking a break (Break n.%zu/%d)%s\n",
+        getpid(), self->nof_pause + 1, ctx->config.nof_pause,
+        forced ? " before closing time" : ""
+    );
+    self->paused = true;
+    self->nof_pause++;
+    if (forced)
+        st->stats.forced_breaks++;
+    sem_signal(st->sem);
+    return true;
+}
+
+/**
+ * @brief Picks a request without blocking from the other stations the
+ * worker's skills allow, once its own queue is empty.
+ * * The request is taken in the victim's queue discipline, as its own workers
+ * would.
+ * * @param ctx Global context.
+ * @param sts Stations array.
+ * @param self Current worker.
+ * @param response Buffer for the request.
+ * @param served Output, station the request belongs to.
+ * @return ssize_t The received size, -1 if every allowed queue is empty.
+ */
+static inline ssize_t
+steal_request(
+    simctx_t       *ctx,
+    station        *sts,
+    const worker_t *self,
+    msg_t          *response,
+    loc_t          *served
+) {
+    ssize_t res;
+
+    /* Start from the next station so stealers spread over the victims */
+    it(k, 1, NOF_STATIONS) {
+        const loc_t victim = (loc_t)((self->role + k) % NOF_STATIONS);
+        if (!ctx->config.skills[self->role][victim])
+            continue;
+
+        res = next_request(ctx, &sts[victim], response, NULL, false);
+        if (res >= 0) {
+            *served = victim;
+
+            sem_wait(sts[victim].sem);
+            sts[victim].stats.stolen++;
+            sem_signal(sts[victim].sem);
+
+            zprintf(
+                ctx->sem[out], "WORKER %d: Stealing a request from station %d\n",
+                getpid(), victim
+            );
+            return res;
         }
     }
+
+    return -1;
 }
 
 /**
  * @brief High-level service handler.
  * * Calculates service time, simulates the delay, and branches into
- * specific food or checkout logic.
+ * specific food or checkout logic. Everything is accounted to the station
+ * the request belongs to, which differs from the worker's one when stolen.
  * * @param self Current worker.
  * @param ctx Global context.
- * @param st Current station.
+ * @param st Station of the request.
  * @param response Client message.
  * @param variance Time variance.
  */
@@ -263,22 +671,31 @@ serve_client(
     msg_t          *response,
     const double    variance
 ) {
-    const size_t avg         = ctx->config.avg_srvc[self->role];
-    const size_t actual_time = get_service_time(avg, variance);
+    size_t avg = ctx->config.avg_srvc[st->type];
+
+    /* Paying takes longer with a fuller tray, avg_srvc is for a full one */
+    if (st->type == CHECKOUT && ctx->config.checkout_by_items &&
+        response->items > 0)
+        avg = (avg * response->items + MAX_DISHES - 1) / MAX_DISHES;
+
+    const size_t actual_time = service_time_at(
+        avg, variance,
+        trace_service(ctx, response->client, st->type, (unsigned)rand())
+    );
 
     zprintf(
         ctx->sem[out], "WORKER %d: Service time %zu ns\n", getpid(), actual_time
     );
 
     /* Simulate the time taken to serve the client */
-    znsleep(actual_time);
+    day_sleep(ctx, actual_time);
 
-    if (self->role != CHECKOUT) {
+    if (st->type != CHECKOUT) {
         sem_wait(ctx->sem[shm]);
-        _serve_food(ctx, self, st, response, actual_time);
+        _serve_food(ctx, st, response, actual_time);
         sem_signal(ctx->sem[shm]);
     } else {
-        _serve_checkout(ctx, st, response);
+        _serve_checkout(ctx, st, response, actual_time);
     }
 }
 
@@ -286,40 +703,21 @@ serve_client(
  * @brief Internal helper to handle food dispensing logic.
  * * Checks inventory, updates stock, and calculates station statistics.
  * * @param ctx Global context.
- * @param self Current worker.
- * @param st Current station.
+ * @param st Station of the request.
  * @param response Client message (updated with dish status).
  * @param time Time spent serving.
  */
 static inline void
-_serve_food(
-    simctx_t       *ctx,
-    const worker_t *self,
-    station        *st,
-    msg_t          *response,
-    size_t          time
-) {
-    const size_t             dish_id      = response->dish.id;
-    ssize_t                  actual_index = -1;
-    struct available_dishes *dishes       = &ctx->avl_dishes[self->role];
-
-    /* Locate the requested dish in the station's available stock */
-    for (size_t i = 0; i < dishes->size; i++) {
-        if (dishes->data[i].id == dish_id) {
-            actual_index = (ssize_t)i;
-            break;
-        }
-    }
+_serve_food(simctx_t *ctx, station *st, msg_t *response, size_t time) {
+    const size_t dish_id = response->dish.id;
+    dish_slot_t *slot    = menu_find(g_menu, (dish_type)st->type, dish_id);
 
-    if (actual_index != -1) {
-        size_t *quantity_p     = (size_t *)&dishes->data[actual_index].quantity;
-        const dish_t dish_info = ctx->menu[self->role].data[actual_index];
-
-        if (*quantity_p > 0) {
+    if (slot != NULL) {
+        if (slot->quantity > 0) {
             /* Decrement stock (COFFEE_BAR is treated as having infinite supply, what a dream)
              */
-            if (self->role != COFFEE_BAR) {
-                *quantity_p -= 1;
+            if (st->type != COFFEE_BAR) {
+                slot->quantity -= 1;
             }
 
             /* Update station metrics */
@@ -327,37 +725,31 @@ _serve_food(
             st->stats.worked_time += time;
 
             response->status = RESPONSE_OK;
-            response->dish   = dish_info;
+            response->dish   = slot->info;
         } else {
             /* Check if the entire category is finished or just this specific
              * dish */
-            bool any_dish_left = false;
-            for (size_t i = 0; i < dishes->size; i++) {
-                if (dishes->data[i].quantity > 0) {
-                    any_dish_left = true;
-                    break;
-                }
-            }
-
-            if (any_dish_left) {
+            if (menu_leftovers(g_menu, (dish_type)st->type) > 0) {
                 zprintf(
                     ctx->sem[out],
                     "WORKER: Dish %zu finished, but others available.\n",
                     dish_id
                 );
                 response->status = RESPONSE_DISH_FINISHED;
+                st->stats.stockouts++;
             } else {
                 zprintf(
                     ctx->sem[out], "WORKER: Station %d completely empty!\n",
-                    self->role
+                    st->type
                 );
                 response->status = RESPONSE_CATEGORY_FINISHED;
+                st->stats.stockouts++;
             }
         }
     } else {
         zprintf(
             ctx->sem[out], "ERROR: Dish ID %zu not found in menu %d\n", dish_id,
-            self->role
+            st->type
         );
         response->status = ERROR;
     }
@@ -366,12 +758,14 @@ _serve_food(
 /**
  * @brief Internal helper to handle payment logic at the checkout.
  * * Checks for "disorder" (system failure) and updates station earnings.
+ * A group payment (body BODY_GROUP_PAY) is settled as a single transaction.
  * * @param ctx Global context.
  * @param st Current station (Checkout).
  * @param response Client message (contains price and ticket info).
+ * @param time Time spent serving.
  */
 static inline void
-_serve_checkout(simctx_t *ctx, station *st, msg_t *response) {
+_serve_checkout(simctx_t *ctx, station *st, msg_t *response, size_t time) {
     /* Verify access via the disorder semaphore to ensure synchronization during
      * chaos events */
     if (sem_wait(ctx->sem[disorder]) == -1) {
@@ -380,29 +774,72 @@ _serve_checkout(simctx_t *ctx, station *st, msg_t *response) {
     }
     sem_signal(ctx->sem[disorder]);
 
-    size_t       price    = response->price;
-    const size_t discount = (price * DISCOUNT_DISH) / 100;
+    size_t price = response->price;
 
-    /* Apply discount if the client has a ticket */
-    if (response->ticket)
-        price -= discount;
+    /* Apply discount if the client has a ticket, a group payment carries the
+     * share of the members that have one */
+    if (response->body == BODY_GROUP_PAY)
+        price -= (response->pay.ticket_price * DISCOUNT_DISH) / 100;
+    else if (response->ticket)
+        price -= (price * DISCOUNT_DISH) / 100;
 
     /* Update earnings safely */
     sem_wait(st->sem);
     st->stats.earnings += price;
+    st->stats.worked_time += time;
+    st->stats.payments++;
     sem_signal(st->sem);
 
     response->status = RESPONSE_OK;
 }
 
 /**
- * @brief Utility to retrieve a pointer to a specific station from shared
- * memory.
- * * @param shmid Shared memory ID for stations.
- * @param role The role/index of the station.
- * @return station* Pointer to the station structure.
+ * @brief Moves the worker to the station requested by the coordinator.
+ * * The record is copied into the same slot of the new station's worker
+ * segment and the old slot is freed; both stations are locked in index order
+ * so two opposite moves can't deadlock. The caller must not hold a seat.
+ * * @param ctx Global context.
+ * @param sts Stations array.
+ * @param idx Global index of the worker, i.e. its slot in every segment.
+ * @param self Current record of the worker.
+ * @param transfer A move of the coordinator, counted in the new station's
+ * transfers once done; going home at the end of the day is not.
+ * @return worker_t* The record in the new station's segment.
  */
-static inline station *
-get_station(const shmid_t shmid, const loc_t role) {
-    return &(get_stations(shmid))[role];
+static worker_t *
+migrate(
+    simctx_t *ctx, station *sts, const size_t idx, worker_t *self,
+    const bool transfer
+) {
+    const loc_t from = self->role;
+    const loc_t to   = self->next_role;
+
+    worker_t *new_wks = get_workers(sts[to].wk_data.shmid);
+
+    station *first  = &sts[from < to ? from : to];
+    station *second = &sts[from < to ? to : from];
+    sem_wait(first->sem);
+    sem_wait(second->sem);
+
+    new_wks[idx]          = *self;
+    new_wks[idx].role     = to;
+    new_wks[idx].queue    = ctx->id_msg_q[to];
+    new_wks[idx].paused   = true;
+    new_wks[idx].activity = WK_IDLE;
+    self->pid             = 0;
+
+    sts[from].wk_data.cap--;
+    sts[to].wk_data.cap++;
+    if (transfer)
+        sts[to].stats.transfers++;
+
+    sem_signal(second->sem);
+    sem_signal(first->sem);
+
+    zprintf(
+        ctx->sem[out], "WORKER %d: Moved from station %d to station %d\n",
+        getpid(), from, to
+    );
+
+    return &new_wks[idx];
 }
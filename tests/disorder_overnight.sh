@@ -0,0 +1,34 @@
+#!/bin/sh
+# Regression: a disorder still running when the day closes must not keep the
+# checkout workers inside it. The coordinator used to wait for them forever
+# in day_drain. Run from the repository root after make.
+set -u
+
+RUN_DIR=$(mktemp -d)
+trap 'rm -rf "$RUN_DIR"' EXIT
+
+timeout 120 ./bin/main --headless --run-dir "$RUN_DIR" \
+    tests/disorder_overnight.json > "$RUN_DIR/summary.json" &
+MAIN=$!
+
+# Start the disorder as soon as the coordinator listens
+tries=0
+until SIM_RUN_DIR="$RUN_DIR" ./bin/simctl start-disorder > /dev/null 2>&1; do
+    tries=$((tries + 1))
+    if [ "$tries" -ge 100 ]; then
+        echo "FAIL: control socket never answered"
+        exit 1
+    fi
+    sleep 0.1
+done
+
+wait "$MAIN"
+rc=$?
+
+# DISORDER_DURATION spans both days: the run ends blocked, not hung
+closed=$(grep -ac 'Day closed' "$RUN_DIR/simulation.log")
+if [ "$rc" -ne 201 ] || [ "$closed" -ne 2 ]; then
+    echo "FAIL: exit code $rc (201 expected), $closed days closed (2 expected)"
+    exit 1
+fi
+echo "PASS: disorder_overnight"